@@ -0,0 +1,679 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/random.h>
+#include <sys/stat.h>
+#include "ta152.h"
+
+// archive layout:
+//   header   32 bytes, "T15A", version, status, iv, entry count in offset_a
+//   entries  ciphertext of every member, back to back in name order
+//   index    table header, slot table, then the NUL-terminated member names
+//   trailer  16 bytes, "T15I", index length (u32), index offset (u64)
+// every entry, the table header, each slot and each name run their own keystream-enabled
+// cipher state, seeded with an IV derived from the header IV and a stream id, so members
+// encrypt and decrypt independently and a lookup decrypts only the slots it probes
+#define ARCHIVE_VERSION 1
+#define ARCHIVE_TRAILER_SIZE 16
+#define ARCHIVE_TABLE_HEADER_SIZE 8
+#define ARCHIVE_SLOT_SIZE 40
+
+// stream ids: entries use their id, below 2^32
+#define ARCHIVE_INDEX_ID 0xFFFFFFFFu
+#define ARCHIVE_SLOT_STREAM (1ULL << 32)
+#define ARCHIVE_NAME_STREAM (2ULL << 32)
+
+struct ArchiveEntry {
+    char *path;
+    const char *name;
+    uint64_t size;
+    uint64_t offset;
+    uint32_t id;
+    int rc;
+};
+
+struct Archive {
+    struct ArchiveEntry *entries;
+    size_t count;
+    size_t cap;
+    int fd;
+    int engine;
+    size_t buf_size;
+    uint8_t key[KEY_SIZE];
+    uint8_t iv[IV_SIZE];
+    const char *out_dir;
+    // index geometry, filled by load_index
+    uint32_t member_count;
+    uint64_t slots;
+    uint64_t index_offset;
+    uint64_t names_offset;
+    uint64_t names_len;
+};
+
+static void le_write_u32(uint8_t *p, uint32_t v) {
+    for (int i = 0; i < 4; i++)
+        p[i] = (uint8_t)(v >> (8 * i));
+}
+
+static uint32_t le_read_u32(const uint8_t *p) {
+    uint32_t v = 0;
+    for (int i = 0; i < 4; i++)
+        v |= (uint32_t)p[i] << (8 * i);
+    return v;
+}
+
+static void le_write_u64(uint8_t *p, uint64_t v) {
+    for (int i = 0; i < 8; i++)
+        p[i] = (uint8_t)(v >> (8 * i));
+}
+
+static uint64_t le_read_u64(const uint8_t *p) {
+    uint64_t v = 0;
+    for (int i = 0; i < 8; i++)
+        v |= (uint64_t)p[i] << (8 * i);
+    return v;
+}
+
+static uint64_t splitmix64(uint64_t z) {
+    z += 0x9e3779b97f4a7c15ULL;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+// FNV-1a, 0 marks an empty index slot
+static uint64_t name_hash(const char *name) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (const char *p = name; *p; p++) {
+        h ^= (uint8_t)*p;
+        h *= 0x100000001b3ULL;
+    }
+    return h ? h : 1;
+}
+
+static void entry_state(struct CipherState *st, const struct Archive *ar, uint64_t id) {
+    uint8_t iv[IV_SIZE];
+    uint64_t x = splitmix64(le_read_u64(ar->iv) + id);
+    uint64_t y = splitmix64(le_read_u64(ar->iv + 8) ^ x);
+
+    le_write_u64(iv, x);
+    le_write_u64(iv + 8, y);
+    ta152_state_init(st, ar->key, STATUS_ON, iv, ar->engine);
+    explicit_bzero(iv, IV_SIZE);
+}
+
+static int pread_all(int fd, void *buffer, size_t len, uint64_t offset) {
+    uint8_t *p = buffer;
+    while (len > 0) {
+        ssize_t r = pread(fd, p, len, (off_t)offset);
+        if (r <= 0)
+            return ERR_NO_READ;
+        p += r;
+        len -= r;
+        offset += r;
+    }
+    return 0;
+}
+
+static int pwrite_all(int fd, const void *buffer, size_t len, uint64_t offset) {
+    const uint8_t *p = buffer;
+    while (len > 0) {
+        ssize_t w = pwrite(fd, p, len, (off_t)offset);
+        if (w <= 0)
+            return ERR_NO_WRITE;
+        p += w;
+        len -= w;
+        offset += w;
+    }
+    return 0;
+}
+
+// run len bytes from in_fd at in_off through st into out_fd at out_off, buf_size bytes at a time;
+// the state carries over, so a long range can be processed in several calls
+int ta152_crypt_range(struct CipherState *st, int dir, int in_fd, uint64_t in_off, int out_fd, uint64_t out_off, uint64_t len, size_t buf_size) {
+    uint8_t *buf = malloc(buf_size);
+    if (!buf)
+        return ERR_NO_MEMORY;
+
+    int rc = 0;
+    uint64_t done = 0;
+    while (done < len) {
+        size_t n = buf_size;
+        if (len - done < n)
+            n = (size_t)(len - done);
+
+        if ((rc = pread_all(in_fd, buf, n, in_off + done)) < 0)
+            break;
+
+        if (dir == DIR_ENCRYPT)
+            ta152_state_encrypt(st, buf, buf, n);
+        else
+            ta152_state_decrypt(st, buf, buf, n);
+
+        if ((rc = pwrite_all(out_fd, buf, n, out_off + done)) < 0)
+            break;
+        done += n;
+    }
+
+    explicit_bzero(buf, buf_size);
+    free(buf);
+    return rc;
+}
+
+static int crypt_range(const struct Archive *ar, uint32_t id, int dir, int in_fd, uint64_t in_off, int out_fd, uint64_t out_off, uint64_t len) {
+    struct CipherState st;
+    entry_state(&st, ar, id);
+
+    int rc = ta152_crypt_range(&st, dir, in_fd, in_off, out_fd, out_off, len, ar->buf_size);
+    ta152_state_wipe(&st);
+    return rc;
+}
+
+static void archive_free(struct Archive *ar) {
+    for (size_t i = 0; i < ar->count; i++)
+        free(ar->entries[i].path);
+    free(ar->entries);
+    explicit_bzero(ar->key, KEY_SIZE);
+    ar->entries = NULL;
+    ar->count = 0;
+    ar->cap = 0;
+}
+
+static struct ArchiveEntry *add_entry(struct Archive *ar) {
+    if (ar->count == ar->cap) {
+        size_t cap = ar->cap ? ar->cap * 2 : 64;
+        struct ArchiveEntry *grown = realloc(ar->entries, cap * sizeof *grown);
+        if (!grown)
+            return NULL;
+        ar->entries = grown;
+        ar->cap = cap;
+    }
+
+    struct ArchiveEntry *e = &ar->entries[ar->count++];
+    memset(e, 0, sizeof *e);
+    return e;
+}
+
+static int collect_member(void *ctx, const char *path, const char *rel, const struct stat *st) {
+    struct Archive *ar = ctx;
+
+    struct ArchiveEntry *e = add_entry(ar);
+    if (!e)
+        return ERR_NO_MEMORY;
+
+    e->path = strdup(path);
+    if (!e->path) {
+        ar->count--;
+        return ERR_NO_MEMORY;
+    }
+    e->name = e->path + (rel - path);
+    e->size = (uint64_t)st->st_size;
+    return 0;
+}
+
+static int entry_name_cmp(const void *a, const void *b) {
+    const struct ArchiveEntry *x = a;
+    const struct ArchiveEntry *y = b;
+    return strcmp(x->name, y->name);
+}
+
+static void pack_task(void *ctx, size_t i) {
+    struct Archive *ar = ctx;
+    struct ArchiveEntry *e = &ar->entries[i];
+
+    int in_fd = open(e->path, O_RDONLY);
+    if (in_fd < 0) {
+        e->rc = ERR_OPEN_FAILED;
+        return;
+    }
+
+    e->rc = crypt_range(ar, e->id, DIR_ENCRYPT, in_fd, 0, ar->fd, e->offset, e->size);
+    close(in_fd);
+}
+
+// runs len bytes at p through the stream with the given id
+static void crypt_stream(const struct Archive *ar, uint64_t id, int dir, uint8_t *p, size_t len) {
+    struct CipherState cs;
+    entry_state(&cs, ar, id);
+    if (dir == DIR_ENCRYPT)
+        ta152_state_encrypt(&cs, p, p, len);
+    else
+        ta152_state_decrypt(&cs, p, p, len);
+    ta152_state_wipe(&cs);
+}
+
+// open-addressed table keyed by name hash, sized to at most half full, returned encrypted
+static uint8_t *build_index(const struct Archive *ar, size_t *out_len) {
+    size_t slots = 2;
+    while (slots < ar->count * 2)
+        slots *= 2;
+
+    size_t names_len = 0;
+    for (size_t i = 0; i < ar->count; i++)
+        names_len += strlen(ar->entries[i].name) + 1;
+
+    size_t len = ARCHIVE_TABLE_HEADER_SIZE + slots * ARCHIVE_SLOT_SIZE + names_len;
+    uint8_t *index = calloc(1, len);
+    if (!index)
+        return NULL;
+
+    le_write_u32(index, (uint32_t)slots);
+    le_write_u32(index + 4, (uint32_t)ar->count);
+
+    uint8_t *table = index + ARCHIVE_TABLE_HEADER_SIZE;
+    uint8_t *names = table + slots * ARCHIVE_SLOT_SIZE;
+    size_t name_off = 0;
+
+    for (size_t i = 0; i < ar->count; i++) {
+        const struct ArchiveEntry *e = &ar->entries[i];
+        uint64_t h = name_hash(e->name);
+        size_t pos = h & (slots - 1);
+        while (le_read_u64(table + pos * ARCHIVE_SLOT_SIZE) != 0)
+            pos = (pos + 1) & (slots - 1);
+
+        size_t n = strlen(e->name) + 1;
+        uint8_t *slot = table + pos * ARCHIVE_SLOT_SIZE;
+        le_write_u64(slot, h);
+        le_write_u64(slot + 8, e->offset);
+        le_write_u64(slot + 16, e->size);
+        le_write_u32(slot + 24, e->id);
+        le_write_u32(slot + 28, (uint32_t)name_off);
+        le_write_u32(slot + 32, (uint32_t)n);
+
+        memcpy(names + name_off, e->name, n);
+        crypt_stream(ar, ARCHIVE_NAME_STREAM + e->id, DIR_ENCRYPT, names + name_off, n);
+        name_off += n;
+    }
+
+    // slots are sealed only once probing is done, empty ones included
+    crypt_stream(ar, ARCHIVE_INDEX_ID, DIR_ENCRYPT, index, ARCHIVE_TABLE_HEADER_SIZE);
+    for (size_t pos = 0; pos < slots; pos++)
+        crypt_stream(ar, ARCHIVE_SLOT_STREAM + pos, DIR_ENCRYPT, table + pos * ARCHIVE_SLOT_SIZE, ARCHIVE_SLOT_SIZE);
+
+    *out_len = len;
+    return index;
+}
+
+// packs every regular file below dir into <dir>.t152a, written to <dir>.t152a.tmp and
+// renamed into place only once complete, so a failed run leaves any previous archive intact
+int ta152_archive_create(const char *dir, const char *key_file, int status_b, const struct EnginePlan *plan, struct TreeStats *stats) {
+    if (!(status_b == STATUS_ON || status_b == STATUS_OFF))
+        return ERR_UNDEFINED_STATUS;
+
+    size_t dir_len = strlen(dir);
+    while (dir_len > 1 && dir[dir_len - 1] == '/')
+        dir_len--;
+
+    char *out_path = malloc(dir_len + 7);
+    char *tmp_path = malloc(dir_len + 11);
+    if (!out_path || !tmp_path) {
+        free(out_path);
+        free(tmp_path);
+        return ERR_NO_PATH_OUT;
+    }
+    memcpy(out_path, dir, dir_len);
+    strcpy(out_path + dir_len, ".t152a");
+    snprintf(tmp_path, dir_len + 11, "%s.tmp", out_path);
+
+    struct Archive ar = {0};
+    ar.fd = -1;
+
+    int rc = ta152_load_key(key_file, ar.key);
+    if (rc == 0 && status_b == STATUS_ON && getrandom(ar.iv, IV_SIZE, 0) != IV_SIZE)
+        rc = ERR_UNINITIALIZED_IV;
+    if (rc == 0)
+        rc = ta152_walk_tree(dir, collect_member, &ar);
+    if (rc == 0 && ar.count >= ARCHIVE_INDEX_ID)
+        rc = ERR_NO_MEMORY;
+    if (rc < 0) {
+        archive_free(&ar);
+        free(out_path);
+        free(tmp_path);
+        return rc;
+    }
+
+    // name order keeps archives without an IV reproducible
+    qsort(ar.entries, ar.count, sizeof *ar.entries, entry_name_cmp);
+
+    uint64_t offset = TA152_HEADER_SIZE;
+    for (size_t i = 0; i < ar.count; i++) {
+        ar.entries[i].id = (uint32_t)i;
+        ar.entries[i].offset = offset;
+        offset += ar.entries[i].size;
+    }
+    uint64_t index_offset = offset;
+
+    struct EnginePlan job;
+    rc = ta152_plan_pool(&job, (long long)(index_offset - TA152_HEADER_SIZE), ar.count, plan);
+    if (rc < 0) {
+        archive_free(&ar);
+        free(out_path);
+        free(tmp_path);
+        return rc;
+    }
+    ar.engine = job.engine;
+    ar.buf_size = job.buf_size;
+
+    ar.fd = open(tmp_path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (ar.fd < 0) {
+        archive_free(&ar);
+        free(out_path);
+        free(tmp_path);
+        return ERR_OPEN_FAILED;
+    }
+
+    uint8_t hdr[TA152_HEADER_SIZE] = { 'T', '1', '5', 'A', ARCHIVE_VERSION, (uint8_t)status_b };
+    memcpy(hdr + 6, ar.iv, IV_SIZE);
+    le_write_u32(hdr + 22, (uint32_t)ar.count);
+
+    rc = pwrite_all(ar.fd, hdr, TA152_HEADER_SIZE, 0);
+    if (rc == 0 && ftruncate(ar.fd, (off_t)index_offset) != 0)
+        rc = ERR_NO_WRITE;
+    if (rc == 0)
+        ta152_parallel_for(job.threads, ar.count, pack_task, &ar);
+
+    struct TreeStats st = {0};
+    for (size_t i = 0; i < ar.count; i++) {
+        st.files++;
+        if (ar.entries[i].rc < 0) {
+            st.failed++;
+            if (rc == 0)
+                rc = ar.entries[i].rc;
+        }
+        else {
+            st.encrypted++;
+            st.bytes += ar.entries[i].size;
+        }
+    }
+
+    size_t index_len = 0;
+    uint8_t *index = NULL;
+    if (rc == 0) {
+        index = build_index(&ar, &index_len);
+        if (!index || index_len > UINT32_MAX)
+            rc = ERR_NO_MEMORY;
+    }
+
+    if (rc == 0) {
+        uint8_t trailer[ARCHIVE_TRAILER_SIZE] = { 'T', '1', '5', 'I' };
+        le_write_u32(trailer + 4, (uint32_t)index_len);
+        le_write_u64(trailer + 8, index_offset);
+
+        rc = pwrite_all(ar.fd, index, index_len, index_offset);
+        if (rc == 0)
+            rc = pwrite_all(ar.fd, trailer, ARCHIVE_TRAILER_SIZE, index_offset + index_len);
+    }
+    free(index);
+
+    if (close(ar.fd) != 0 && rc == 0)
+        rc = ERR_CLOSE_FAILED;
+    if (rc == 0 && rename(tmp_path, out_path) != 0)
+        rc = ERR_NO_WRITE;
+    if (rc < 0)
+        unlink(tmp_path);
+    archive_free(&ar);
+    free(out_path);
+    free(tmp_path);
+
+    if (stats)
+        *stats = st;
+    if (rc < 0)
+        return rc;
+    return SUCCESS_ENCRYPT;
+}
+
+// member names come from the decrypted index, refuse anything that escapes the output directory
+static int name_safe(const char *name) {
+    if (name[0] == '\0' || name[0] == '/')
+        return 0;
+
+    const char *p = name;
+    while (*p) {
+        size_t n = strcspn(p, "/");
+        if (n == 0 || (n == 1 && p[0] == '.') || (n == 2 && p[0] == '.' && p[1] == '.'))
+            return 0;
+        p += n;
+        if (*p == '/')
+            p++;
+    }
+    return 1;
+}
+
+// reads the archive header, trailer and table header into ar; a wrong key turns the table
+// header into noise, which these bounds reject
+static int load_index(struct Archive *ar) {
+    uint8_t hdr[TA152_HEADER_SIZE];
+    if (pread_all(ar->fd, hdr, TA152_HEADER_SIZE, 0) < 0)
+        return ERR_NO_READ;
+
+    if (!(hdr[0] == 'T' && hdr[1] == '1' && hdr[2] == '5' && hdr[3] == 'A'))
+        return ERR_HEADER_INVALID;
+    if (hdr[4] > ARCHIVE_VERSION || hdr[4] < 1)
+        return ERR_UNSUPPORTED_VERSION;
+    if (!(hdr[5] == STATUS_ON || hdr[5] == STATUS_OFF))
+        return ERR_UNDEFINED_STATUS;
+    memcpy(ar->iv, hdr + 6, IV_SIZE);
+    uint32_t count = le_read_u32(hdr + 22);
+
+    struct stat st;
+    if (fstat(ar->fd, &st) != 0)
+        return ERR_CANNOT_STAT_SIZE;
+    uint64_t file_size = (uint64_t)st.st_size;
+    if (file_size < TA152_HEADER_SIZE + ARCHIVE_TRAILER_SIZE)
+        return ERR_HEADER_INVALID;
+
+    uint8_t trailer[ARCHIVE_TRAILER_SIZE];
+    if (pread_all(ar->fd, trailer, ARCHIVE_TRAILER_SIZE, file_size - ARCHIVE_TRAILER_SIZE) < 0)
+        return ERR_NO_READ;
+    if (!(trailer[0] == 'T' && trailer[1] == '1' && trailer[2] == '5' && trailer[3] == 'I'))
+        return ERR_HEADER_INVALID;
+
+    uint64_t index_len = le_read_u32(trailer + 4);
+    uint64_t index_offset = le_read_u64(trailer + 8);
+    if (index_offset < TA152_HEADER_SIZE || index_len < ARCHIVE_TABLE_HEADER_SIZE ||
+        index_offset > file_size || index_len != file_size - ARCHIVE_TRAILER_SIZE - index_offset)
+        return ERR_HEADER_INVALID;
+
+    uint8_t table_hdr[ARCHIVE_TABLE_HEADER_SIZE];
+    if (pread_all(ar->fd, table_hdr, ARCHIVE_TABLE_HEADER_SIZE, index_offset) < 0)
+        return ERR_NO_READ;
+    crypt_stream(ar, ARCHIVE_INDEX_ID, DIR_DECRYPT, table_hdr, ARCHIVE_TABLE_HEADER_SIZE);
+
+    uint64_t slots = le_read_u32(table_hdr);
+    if (le_read_u32(table_hdr + 4) != count || slots < 2 || (slots & (slots - 1)) != 0 || count > slots ||
+        ARCHIVE_TABLE_HEADER_SIZE + slots * ARCHIVE_SLOT_SIZE > index_len)
+        return ERR_HEADER_INVALID;
+
+    ar->member_count = count;
+    ar->slots = slots;
+    ar->index_offset = index_offset;
+    ar->names_offset = index_offset + ARCHIVE_TABLE_HEADER_SIZE + slots * ARCHIVE_SLOT_SIZE;
+    ar->names_len = index_len - ARCHIVE_TABLE_HEADER_SIZE - slots * ARCHIVE_SLOT_SIZE;
+    return 0;
+}
+
+// decrypts slot pos into e and returns its name hash, 0 for an empty slot
+static int read_slot(const struct Archive *ar, uint64_t pos, struct ArchiveEntry *e, uint64_t *hash, uint32_t *name_off, uint32_t *name_len) {
+    uint8_t slot[ARCHIVE_SLOT_SIZE];
+    if (pread_all(ar->fd, slot, ARCHIVE_SLOT_SIZE, ar->index_offset + ARCHIVE_TABLE_HEADER_SIZE + pos * ARCHIVE_SLOT_SIZE) < 0)
+        return ERR_NO_READ;
+    crypt_stream(ar, ARCHIVE_SLOT_STREAM + pos, DIR_DECRYPT, slot, ARCHIVE_SLOT_SIZE);
+
+    *hash = le_read_u64(slot);
+    if (*hash == 0)
+        return 0;
+
+    e->offset = le_read_u64(slot + 8);
+    e->size = le_read_u64(slot + 16);
+    e->id = le_read_u32(slot + 24);
+    *name_off = le_read_u32(slot + 28);
+    *name_len = le_read_u32(slot + 32);
+
+    uint64_t end = ar->index_offset;
+    if (e->offset < TA152_HEADER_SIZE || e->size > end || e->offset > end - e->size || e->id >= ar->member_count ||
+        *name_len == 0 || *name_off >= ar->names_len || *name_len > ar->names_len - *name_off)
+        return ERR_HEADER_INVALID;
+    return 0;
+}
+
+// decrypts the name of e into a fresh string owned by e->path
+static int read_name(const struct Archive *ar, struct ArchiveEntry *e, uint32_t name_off, uint32_t name_len) {
+    char *name = malloc(name_len);
+    if (!name)
+        return ERR_NO_MEMORY;
+    if (pread_all(ar->fd, name, name_len, ar->names_offset + name_off) < 0) {
+        free(name);
+        return ERR_NO_READ;
+    }
+    crypt_stream(ar, ARCHIVE_NAME_STREAM + e->id, DIR_DECRYPT, (uint8_t *)name, name_len);
+
+    if (name[name_len - 1] != '\0' || strlen(name) != name_len - 1 || !name_safe(name)) {
+        free(name);
+        return ERR_HEADER_INVALID;
+    }
+    e->path = name;
+    e->name = name;
+    return 0;
+}
+
+static void unpack_task(void *ctx, size_t i) {
+    struct Archive *ar = ctx;
+    struct ArchiveEntry *e = &ar->entries[i];
+
+    size_t len = strlen(ar->out_dir) + strlen(e->name) + 2;
+    char *out_path = malloc(len);
+    if (!out_path) {
+        e->rc = ERR_NO_PATH_OUT;
+        return;
+    }
+    snprintf(out_path, len, "%s/%s", ar->out_dir, e->name);
+
+    if (ta152_make_parents(out_path) < 0) {
+        free(out_path);
+        e->rc = ERR_OPEN_FAILED;
+        return;
+    }
+
+    int out_fd = open(out_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    free(out_path);
+    if (out_fd < 0) {
+        e->rc = ERR_OPEN_FAILED;
+        return;
+    }
+
+    e->rc = crypt_range(ar, e->id, DIR_DECRYPT, ar->fd, e->offset, out_fd, 0, e->size);
+    if (close(out_fd) != 0 && e->rc == 0)
+        e->rc = ERR_CLOSE_FAILED;
+}
+
+// extracts member (or every member when NULL) of archive into the archive path without .t152a,
+// a single member is found through the index without touching any other entry
+int ta152_archive_extract(const char *archive, const char *key_file, const char *member, const struct EnginePlan *plan, struct TreeStats *stats) {
+    size_t len = strlen(archive);
+    char *out_dir = malloc(len + 3);
+    if (!out_dir)
+        return ERR_NO_PATH_OUT;
+    strcpy(out_dir, archive);
+    if (len > 6 && strcmp(out_dir + len - 6, ".t152a") == 0)
+        out_dir[len - 6] = '\0';
+    else
+        strcat(out_dir, ".d");
+
+    struct Archive ar = {0};
+    ar.out_dir = out_dir;
+    ar.fd = open(archive, O_RDONLY);
+    if (ar.fd < 0) {
+        free(out_dir);
+        return ERR_OPEN_FAILED;
+    }
+
+    int rc = ta152_load_key(key_file, ar.key);
+    if (rc == 0)
+        rc = load_index(&ar);
+
+    // a single member probes from its hash and stops at the first empty slot
+    uint64_t slots = rc == 0 ? ar.slots : 0;
+    uint64_t want = member ? name_hash(member) : 0;
+    uint64_t pos = member ? want & (slots - 1) : 0;
+    for (uint64_t probed = 0; rc == 0 && probed < slots; probed++, pos = (pos + 1) & (slots - 1)) {
+        struct ArchiveEntry found = {0};
+        uint64_t h;
+        uint32_t name_off = 0;
+        uint32_t name_len = 0;
+        if ((rc = read_slot(&ar, pos, &found, &h, &name_off, &name_len)) < 0)
+            break;
+        if (h == 0) {
+            if (member)
+                break;
+            continue;
+        }
+        if (member && h != want)
+            continue;
+
+        if ((rc = read_name(&ar, &found, name_off, name_len)) < 0)
+            break;
+        if (member && strcmp(found.name, member) != 0) {
+            free(found.path);
+            continue;
+        }
+
+        struct ArchiveEntry *e = add_entry(&ar);
+        if (!e) {
+            free(found.path);
+            rc = ERR_NO_MEMORY;
+            break;
+        }
+        *e = found;
+
+        if (member)
+            break;
+    }
+
+    if (rc == 0 && member && ar.count == 0)
+        rc = ERR_MEMBER_NOT_FOUND;
+    if (rc == 0 && !member && ar.count != ar.member_count)
+        rc = ERR_HEADER_INVALID;
+
+    long long total = 0;
+    for (size_t i = 0; i < ar.count; i++)
+        total += (long long)ar.entries[i].size;
+
+    struct EnginePlan job;
+    if (rc == 0)
+        rc = ta152_plan_pool(&job, total, ar.count, plan);
+    if (rc == 0) {
+        ar.engine = job.engine;
+        ar.buf_size = job.buf_size;
+        ta152_parallel_for(job.threads, ar.count, unpack_task, &ar);
+    }
+
+    struct TreeStats st = {0};
+    for (size_t i = 0; rc == 0 && i < ar.count; i++) {
+        st.files++;
+        if (ar.entries[i].rc < 0) {
+            st.failed++;
+        }
+        else {
+            st.encrypted++;
+            st.bytes += ar.entries[i].size;
+        }
+    }
+    for (size_t i = 0; rc == 0 && i < ar.count; i++) {
+        if (ar.entries[i].rc < 0)
+            rc = ar.entries[i].rc;
+    }
+
+    archive_free(&ar);
+    close(ar.fd);
+    free(out_dir);
+
+    if (stats)
+        *stats = st;
+    if (rc < 0)
+        return rc;
+    return SUCCESS_DECRYPT;
+}
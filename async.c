@@ -0,0 +1,418 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include <sys/random.h>
+#include "ta152.h"
+
+// job lifecycle, guarded by the context lock
+#define JOB_QUEUED 1
+#define JOB_RUNNING 2
+#define JOB_DONE 3
+
+#define ASYNC_DEFAULT_DEPTH 256
+// buffer and range jobs check for cancellation between slices
+#define ASYNC_SLICE (1024 * 1024)
+
+struct AsyncContext {
+    pthread_mutex_t lock;
+    pthread_cond_t work;
+    struct AsyncJob *queue_head;
+    struct AsyncJob *queue_tail;
+    struct AsyncJob *done_head;
+    struct AsyncJob *done_tail;
+    int depth;
+    int inflight;
+    int stopping;
+    int efd;
+    int threads;
+    pthread_t *tids;
+};
+
+static int job_cancelled(struct AsyncContext *ctx, struct AsyncJob *job) {
+    pthread_mutex_lock(&ctx->lock);
+    int cancel = job->cancel;
+    pthread_mutex_unlock(&ctx->lock);
+    return cancel;
+}
+
+// what a job's plan polls between buffers: ta152_cancel, then any hook the caller set
+struct CancelProbe {
+    struct AsyncContext *ctx;
+    struct AsyncJob *job;
+};
+
+static int probe_cancel(void *arg) {
+    struct CancelProbe *probe = arg;
+    if (job_cancelled(probe->ctx, probe->job))
+        return 1;
+    return probe->job->plan.cancel && probe->job->plan.cancel(probe->job->plan.cancel_ctx);
+}
+
+// runs len bytes through st one slice at a time, stopping early on cancellation
+static int process_slices(struct AsyncContext *ctx, struct AsyncJob *job, struct CipherState *st, int dir,
+                          const uint8_t *in, uint8_t *out, size_t len) {
+    size_t done = 0;
+    while (done < len) {
+        if (job_cancelled(ctx, job))
+            return ERR_CANCELLED;
+
+        size_t n = len - done < ASYNC_SLICE ? len - done : ASYNC_SLICE;
+        if (dir == DIR_ENCRYPT)
+            ta152_state_encrypt(st, in + done, out + done, n);
+        else
+            ta152_state_decrypt(st, in + done, out + done, n);
+        done += n;
+    }
+    return 0;
+}
+
+static int run_buffer_job(struct AsyncContext *ctx, struct AsyncJob *job, const struct EnginePlan *plan) {
+    struct EnginePlan run;
+    struct CipherState st;
+    int rc;
+
+    if (job->op == JOB_ENCRYPT) {
+        if (job->in_len > UINT32_MAX)
+            return ERR_CANNOT_STAT_SIZE;
+        if (job->out_cap < job->in_len + TA152_HEADER_SIZE)
+            return ERR_BUFFER_TOO_SMALL;
+
+        uint8_t iv[IV_SIZE] = {0};
+        if (job->status == STATUS_ON && getrandom(iv, IV_SIZE, 0) != IV_SIZE)
+            return ERR_UNINITIALIZED_IV;
+        if ((rc = ta152_plan_job(&run, (long long)job->in_len, plan)) < 0)
+            return rc;
+
+        ta152_header_encode(job->out_buf, job->status, iv, (uint32_t)job->in_len);
+        ta152_state_init(&st, job->key, job->status, iv, run.engine);
+        rc = process_slices(ctx, job, &st, DIR_ENCRYPT, job->in_buf, job->out_buf + TA152_HEADER_SIZE, job->in_len);
+        job->out_len = job->in_len + TA152_HEADER_SIZE;
+    }
+    else if (job->op == JOB_DECRYPT) {
+        int status;
+        uint8_t iv[IV_SIZE];
+        uint32_t file_size;
+
+        if (job->in_len < TA152_HEADER_SIZE)
+            return ERR_HEADER_INVALID;
+        if ((rc = ta152_header_decode(job->in_buf, &status, iv, &file_size)) < 0)
+            return rc;
+        if (job->in_len - TA152_HEADER_SIZE != file_size)
+            return ERR_HEADER_INVALID;
+        if (job->out_cap < file_size)
+            return ERR_BUFFER_TOO_SMALL;
+        if ((rc = ta152_plan_job(&run, file_size, plan)) < 0)
+            return rc;
+
+        ta152_state_init(&st, job->key, status, iv, run.engine);
+        rc = process_slices(ctx, job, &st, DIR_DECRYPT, job->in_buf + TA152_HEADER_SIZE, job->out_buf, file_size);
+        job->out_len = file_size;
+    }
+    else {
+        if (job->out_cap < job->in_len)
+            return ERR_BUFFER_TOO_SMALL;
+        if ((rc = ta152_plan_job(&run, (long long)job->in_len, plan)) < 0)
+            return rc;
+
+        ta152_state_init(&st, job->key, job->status, job->iv, run.engine);
+        rc = process_slices(ctx, job, &st, job->dir, job->in_buf, job->out_buf, job->in_len);
+        job->out_len = job->in_len;
+    }
+
+    ta152_state_wipe(&st);
+    if (rc < 0)
+        return rc;
+    return job->op == JOB_DECRYPT ? SUCCESS_DECRYPT : SUCCESS_ENCRYPT;
+}
+
+// a raw stream between two fds at fixed offsets, no header is read or written
+static int run_range_fd_job(struct AsyncContext *ctx, struct AsyncJob *job, const struct EnginePlan *plan) {
+    struct EnginePlan run;
+    int rc = ta152_plan_job(&run, (long long)job->length, plan);
+    if (rc < 0)
+        return rc;
+
+    struct CipherState st;
+    ta152_state_init(&st, job->key, job->status, job->iv, run.engine);
+
+    uint64_t done = 0;
+    while (rc == 0 && done < job->length) {
+        if (job_cancelled(ctx, job)) {
+            rc = ERR_CANCELLED;
+            break;
+        }
+
+        uint64_t n = job->length - done < ASYNC_SLICE ? job->length - done : ASYNC_SLICE;
+        rc = ta152_crypt_range(&st, job->dir, job->in_fd, job->in_offset + done,
+                               job->out_fd, job->out_offset + done, n, run.buf_size);
+        done += n;
+    }
+
+    ta152_state_wipe(&st);
+    job->out_len = (size_t)done;
+    if (rc < 0)
+        return rc;
+    return job->dir == DIR_DECRYPT ? SUCCESS_DECRYPT : SUCCESS_ENCRYPT;
+}
+
+static int run_job(struct AsyncContext *ctx, struct AsyncJob *job) {
+    // the pool already runs one job per worker, so jobs default to a single thread
+    struct EnginePlan plan = job->plan;
+    if (plan.threads <= 0)
+        plan.threads = 1;
+    struct CancelProbe probe = { ctx, job };
+    plan.cancel = probe_cancel;
+    plan.cancel_ctx = &probe;
+
+    switch (job->src) {
+        case JOB_SRC_PATH:
+            if (job->op == JOB_ENCRYPT)
+                return ta152_encrypt_plan(job->in_path, job->key_file, job->status, &plan);
+            return ta152_decrypt_plan(job->in_path, job->key_file, &plan);
+        case JOB_SRC_FD:
+            if (job->op == JOB_ENCRYPT)
+                return ta152_encrypt_fd(job->in_fd, job->out_fd, job->key, job->status, &plan);
+            if (job->op == JOB_DECRYPT)
+                return ta152_decrypt_fd(job->in_fd, job->out_fd, job->key, &plan);
+            return run_range_fd_job(ctx, job, &plan);
+        default:
+            return run_buffer_job(ctx, job, &plan);
+    }
+}
+
+// hands a finished job back: to its callback, or to the completion list behind the eventfd
+static void deliver(struct AsyncContext *ctx, struct AsyncJob *job) {
+    if (job->callback) {
+        // the job belongs to the caller again once the callback runs
+        job->callback(job, job->callback_arg);
+        return;
+    }
+
+    pthread_mutex_lock(&ctx->lock);
+    job->next = NULL;
+    if (ctx->done_tail)
+        ctx->done_tail->next = job;
+    else
+        ctx->done_head = job;
+    ctx->done_tail = job;
+    pthread_mutex_unlock(&ctx->lock);
+
+    uint64_t one = 1;
+    ssize_t w = write(ctx->efd, &one, sizeof one);
+    (void)w;
+}
+
+static void *async_worker(void *arg) {
+    struct AsyncContext *ctx = arg;
+
+    while (1) {
+        pthread_mutex_lock(&ctx->lock);
+        while (!ctx->queue_head && !ctx->stopping)
+            pthread_cond_wait(&ctx->work, &ctx->lock);
+
+        struct AsyncJob *job = ctx->queue_head;
+        if (!job) {
+            pthread_mutex_unlock(&ctx->lock);
+            return NULL;
+        }
+        ctx->queue_head = job->next;
+        if (!ctx->queue_head)
+            ctx->queue_tail = NULL;
+        job->state = JOB_RUNNING;
+        pthread_mutex_unlock(&ctx->lock);
+
+        int rc = run_job(ctx, job);
+
+        pthread_mutex_lock(&ctx->lock);
+        job->rc = rc;
+        job->state = JOB_DONE;
+        ctx->inflight--;
+        pthread_mutex_unlock(&ctx->lock);
+
+        deliver(ctx, job);
+    }
+}
+
+// threads <= 0 sizes the pool from the online CPU count, depth bounds queued plus running jobs;
+// calibration is left to the workers so creating a context never runs the benchmark
+int ta152_async_create(struct AsyncContext **out, int threads, int depth) {
+    if (threads <= 0) {
+        long nproc = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = nproc > 0 ? (int)nproc : 1;
+    }
+    if (depth <= 0)
+        depth = ASYNC_DEFAULT_DEPTH;
+
+    struct AsyncContext *ctx = calloc(1, sizeof *ctx);
+    if (!ctx)
+        return ERR_NO_MEMORY;
+
+    ctx->depth = depth;
+    ctx->efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    ctx->tids = calloc(threads, sizeof *ctx->tids);
+    if (ctx->efd < 0 || !ctx->tids) {
+        if (ctx->efd >= 0)
+            close(ctx->efd);
+        free(ctx->tids);
+        free(ctx);
+        return ERR_NO_MEMORY;
+    }
+
+    pthread_mutex_init(&ctx->lock, NULL);
+    pthread_cond_init(&ctx->work, NULL);
+
+    for (; ctx->threads < threads; ctx->threads++) {
+        if (pthread_create(&ctx->tids[ctx->threads], NULL, async_worker, ctx) != 0)
+            break;
+    }
+
+    if (ctx->threads == 0) {
+        ta152_async_destroy(ctx);
+        return ERR_NO_MEMORY;
+    }
+
+    *out = ctx;
+    return 0;
+}
+
+// becomes readable whenever completions are waiting in ta152_reap
+int ta152_async_fd(const struct AsyncContext *ctx) {
+    return ctx->efd;
+}
+
+// queues job without blocking; ERR_QUEUE_FULL asks the caller to reap first
+int ta152_submit(struct AsyncContext *ctx, struct AsyncJob *job) {
+    if (job->op < JOB_ENCRYPT || job->op > JOB_RANGE || job->src < JOB_SRC_PATH || job->src > JOB_SRC_BUFFER)
+        return ERR_INVALID_JOB;
+    if (job->op == JOB_RANGE && job->src == JOB_SRC_PATH)
+        return ERR_INVALID_JOB;
+    if ((job->op == JOB_ENCRYPT || job->op == JOB_RANGE) && !(job->status == STATUS_ON || job->status == STATUS_OFF))
+        return ERR_UNDEFINED_STATUS;
+
+    pthread_mutex_lock(&ctx->lock);
+    if (ctx->stopping) {
+        pthread_mutex_unlock(&ctx->lock);
+        return ERR_CANCELLED;
+    }
+    if (ctx->inflight >= ctx->depth) {
+        pthread_mutex_unlock(&ctx->lock);
+        return ERR_QUEUE_FULL;
+    }
+
+    job->rc = 0;
+    job->out_len = 0;
+    job->cancel = 0;
+    job->state = JOB_QUEUED;
+    job->next = NULL;
+    if (ctx->queue_tail)
+        ctx->queue_tail->next = job;
+    else
+        ctx->queue_head = job;
+    ctx->queue_tail = job;
+    ctx->inflight++;
+
+    pthread_cond_signal(&ctx->work);
+    pthread_mutex_unlock(&ctx->lock);
+    return 0;
+}
+
+// a queued job completes right away with ERR_CANCELLED (CANCEL_DONE), a running job is
+// asked to stop at its next slice or buffer and completes with ERR_CANCELLED unless it
+// finishes first (CANCEL_REQUESTED)
+int ta152_cancel(struct AsyncContext *ctx, struct AsyncJob *job) {
+    pthread_mutex_lock(&ctx->lock);
+
+    if (job->state == JOB_RUNNING) {
+        job->cancel = 1;
+        pthread_mutex_unlock(&ctx->lock);
+        return CANCEL_REQUESTED;
+    }
+
+    if (job->state != JOB_QUEUED) {
+        pthread_mutex_unlock(&ctx->lock);
+        return ERR_JOB_NOT_FOUND;
+    }
+
+    struct AsyncJob **link = &ctx->queue_head;
+    struct AsyncJob *prev = NULL;
+    while (*link != job) {
+        prev = *link;
+        link = &(*link)->next;
+    }
+    *link = job->next;
+    if (ctx->queue_tail == job)
+        ctx->queue_tail = prev;
+
+    job->rc = ERR_CANCELLED;
+    job->state = JOB_DONE;
+    ctx->inflight--;
+    pthread_mutex_unlock(&ctx->lock);
+
+    deliver(ctx, job);
+    return CANCEL_DONE;
+}
+
+// moves up to max completed jobs into jobs and clears the eventfd, returns how many
+int ta152_reap(struct AsyncContext *ctx, struct AsyncJob **jobs, int max) {
+    uint64_t pending;
+    ssize_t r = read(ctx->efd, &pending, sizeof pending);
+    (void)r;
+
+    int n = 0;
+    pthread_mutex_lock(&ctx->lock);
+    while (n < max && ctx->done_head) {
+        struct AsyncJob *job = ctx->done_head;
+        ctx->done_head = job->next;
+        job->next = NULL;
+        jobs[n++] = job;
+    }
+    if (!ctx->done_head)
+        ctx->done_tail = NULL;
+    int left = ctx->done_head != NULL;
+    pthread_mutex_unlock(&ctx->lock);
+
+    // keep the fd readable while completions remain beyond max
+    if (left) {
+        uint64_t one = 1;
+        ssize_t w = write(ctx->efd, &one, sizeof one);
+        (void)w;
+    }
+    return n;
+}
+
+// cancels queued jobs, waits for running ones and frees the context; unreaped
+// completions are dropped, so reap first
+void ta152_async_destroy(struct AsyncContext *ctx) {
+    pthread_mutex_lock(&ctx->lock);
+    ctx->stopping = 1;
+    struct AsyncJob *queued = ctx->queue_head;
+    ctx->queue_head = NULL;
+    ctx->queue_tail = NULL;
+    for (struct AsyncJob *job = queued; job; job = job->next) {
+        job->rc = ERR_CANCELLED;
+        job->state = JOB_DONE;
+        ctx->inflight--;
+    }
+    pthread_cond_broadcast(&ctx->work);
+    pthread_mutex_unlock(&ctx->lock);
+
+    while (queued) {
+        struct AsyncJob *next = queued->next;
+        if (queued->callback)
+            queued->callback(queued, queued->callback_arg);
+        queued = next;
+    }
+
+    for (int i = 0; i < ctx->threads; i++)
+        pthread_join(ctx->tids[i], NULL);
+
+    pthread_cond_destroy(&ctx->work);
+    pthread_mutex_destroy(&ctx->lock);
+    close(ctx->efd);
+    free(ctx->tids);
+    free(ctx);
+}
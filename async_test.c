@@ -0,0 +1,263 @@
+// checks of the async job API (async.c) against the direct cipher calls
+// usage: ta152_async_test
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include "ta152.h"
+
+#define TEST_LEN (64 * 1024)
+
+static int failures = 0;
+
+static void check(int ok, const char *what) {
+    printf("%-44s %s\n", what, ok ? "ok" : "MISMATCH");
+    if (!ok)
+        failures++;
+}
+
+static const uint8_t test_key[KEY_SIZE] = { 3, 1, 4, 1, 5, 9, 2, 6, 5, 3, 5, 8, 9, 7, 9, 3 };
+static const uint8_t test_iv[IV_SIZE] = { 2, 7, 1, 8, 2, 8, 1, 8, 2, 8, 4, 5, 9, 0, 4, 5 };
+
+// blocks until n jobs were reaped through the eventfd
+static void wait_reaped(struct AsyncContext *ctx, struct AsyncJob **jobs, int n) {
+    int got = 0;
+    while (got < n) {
+        struct pollfd pfd = { ta152_async_fd(ctx), POLLIN, 0 };
+        if (poll(&pfd, 1, -1) > 0)
+            got += ta152_reap(ctx, jobs + got, n - got);
+    }
+}
+
+// callback side: counts deliveries and wakes the main thread
+struct Delivery {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int count;
+};
+
+static void on_done(struct AsyncJob *job, void *arg) {
+    (void)job;
+    struct Delivery *d = arg;
+    pthread_mutex_lock(&d->lock);
+    d->count++;
+    pthread_cond_signal(&d->cond);
+    pthread_mutex_unlock(&d->lock);
+}
+
+// plan cancel hook that holds its job at the first buffer until the main thread releases it,
+// so the job is known to be running when ta152_cancel is called
+struct Gate {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int started;
+    int open;
+};
+
+static int hold_first_buffer(void *arg) {
+    struct Gate *g = arg;
+    pthread_mutex_lock(&g->lock);
+    g->started = 1;
+    pthread_cond_broadcast(&g->cond);
+    while (!g->open)
+        pthread_cond_wait(&g->cond, &g->lock);
+    pthread_mutex_unlock(&g->lock);
+    return 0;
+}
+
+static FILE *temp_with(const uint8_t *buf, size_t len) {
+    FILE *f = tmpfile();
+    if (f && buf && fwrite(buf, 1, len, f) != len) {
+        fclose(f);
+        return NULL;
+    }
+    if (f)
+        fflush(f);
+    return f;
+}
+
+static int file_equals(FILE *f, const uint8_t *buf, size_t len) {
+    uint8_t *got = malloc(len + 1);
+    if (!got)
+        return 0;
+    size_t n = (size_t)pread(fileno(f), got, len + 1, 0);
+    int same = n == len && memcmp(got, buf, len) == 0;
+    free(got);
+    return same;
+}
+
+static void prepare(struct AsyncJob *job, int op, int src) {
+    memset(job, 0, sizeof *job);
+    job->op = op;
+    job->src = src;
+    job->status = STATUS_ON;
+    memcpy(job->key, test_key, KEY_SIZE);
+    memcpy(job->iv, test_iv, IV_SIZE);
+    // a fixed engine keeps calibration out of the test
+    job->plan.engine = ENGINE_TABLE;
+}
+
+int main(void) {
+    uint8_t *plain = malloc(TEST_LEN);
+    uint8_t *cipher = malloc(TEST_LEN + TA152_HEADER_SIZE);
+    uint8_t *back = malloc(TEST_LEN);
+    uint8_t *ref = malloc(TEST_LEN);
+    if (!plain || !cipher || !back || !ref)
+        return EXIT_FAILURE;
+    for (size_t i = 0; i < TEST_LEN; i++)
+        plain[i] = (uint8_t)(i * 31 + (i >> 8));
+
+    struct CipherState st;
+    ta152_state_init(&st, test_key, STATUS_ON, test_iv, ENGINE_SCALAR);
+    ta152_state_encrypt(&st, plain, ref, TEST_LEN);
+    ta152_state_wipe(&st);
+
+    struct AsyncContext *ctx;
+    if (ta152_async_create(&ctx, 2, 0) < 0)
+        return EXIT_FAILURE;
+    struct AsyncJob *reaped[4];
+
+    // buffer jobs, delivered through the eventfd
+    struct AsyncJob enc, dec;
+    prepare(&enc, JOB_ENCRYPT, JOB_SRC_BUFFER);
+    enc.in_buf = plain;
+    enc.in_len = TEST_LEN;
+    enc.out_buf = cipher;
+    enc.out_cap = TEST_LEN + TA152_HEADER_SIZE;
+    check(ta152_submit(ctx, &enc) == 0, "submit buffer encrypt");
+    wait_reaped(ctx, reaped, 1);
+    check(reaped[0] == &enc && enc.rc == SUCCESS_ENCRYPT && enc.out_len == TEST_LEN + TA152_HEADER_SIZE,
+          "buffer encrypt reaped");
+
+    prepare(&dec, JOB_DECRYPT, JOB_SRC_BUFFER);
+    dec.in_buf = cipher;
+    dec.in_len = enc.out_len;
+    dec.out_buf = back;
+    dec.out_cap = TEST_LEN;
+    ta152_submit(ctx, &dec);
+    wait_reaped(ctx, reaped, 1);
+    check(dec.rc == SUCCESS_DECRYPT && dec.out_len == TEST_LEN && memcmp(back, plain, TEST_LEN) == 0,
+          "buffer decrypt round-trip");
+
+    // range job over a buffer, delivered to a callback
+    struct Delivery d = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, 0 };
+    struct AsyncJob range;
+    prepare(&range, JOB_RANGE, JOB_SRC_BUFFER);
+    range.dir = DIR_ENCRYPT;
+    range.in_buf = plain;
+    range.in_len = TEST_LEN;
+    range.out_buf = back;
+    range.out_cap = TEST_LEN;
+    range.callback = on_done;
+    range.callback_arg = &d;
+    ta152_submit(ctx, &range);
+    pthread_mutex_lock(&d.lock);
+    while (d.count < 1)
+        pthread_cond_wait(&d.cond, &d.lock);
+    pthread_mutex_unlock(&d.lock);
+    check(range.rc == SUCCESS_ENCRYPT && memcmp(back, ref, TEST_LEN) == 0, "buffer range via callback vs C scalar");
+
+    // fd jobs: encrypt, decrypt, and a range between two files
+    FILE *in = temp_with(plain, TEST_LEN);
+    FILE *ct = temp_with(NULL, 0);
+    FILE *pt = temp_with(NULL, 0);
+    FILE *raw = temp_with(NULL, 0);
+    if (!in || !ct || !pt || !raw)
+        return EXIT_FAILURE;
+
+    prepare(&enc, JOB_ENCRYPT, JOB_SRC_FD);
+    enc.in_fd = fileno(in);
+    enc.out_fd = fileno(ct);
+    ta152_submit(ctx, &enc);
+    wait_reaped(ctx, reaped, 1);
+    check(enc.rc == SUCCESS_ENCRYPT, "fd encrypt");
+
+    prepare(&dec, JOB_DECRYPT, JOB_SRC_FD);
+    dec.in_fd = fileno(ct);
+    dec.out_fd = fileno(pt);
+    ta152_submit(ctx, &dec);
+    wait_reaped(ctx, reaped, 1);
+    check(dec.rc == SUCCESS_DECRYPT && file_equals(pt, plain, TEST_LEN), "fd decrypt round-trip");
+
+    prepare(&range, JOB_RANGE, JOB_SRC_FD);
+    range.dir = DIR_ENCRYPT;
+    range.in_fd = fileno(in);
+    range.out_fd = fileno(raw);
+    range.length = TEST_LEN;
+    ta152_submit(ctx, &range);
+    wait_reaped(ctx, reaped, 1);
+    check(range.rc == SUCCESS_ENCRYPT && file_equals(raw, ref, TEST_LEN), "fd range vs C scalar");
+
+    int pipe_fds[2];
+    if (pipe(pipe_fds) != 0)
+        return EXIT_FAILURE;
+    prepare(&enc, JOB_ENCRYPT, JOB_SRC_FD);
+    enc.in_fd = pipe_fds[0];
+    enc.out_fd = fileno(raw);
+    ta152_submit(ctx, &enc);
+    wait_reaped(ctx, reaped, 1);
+    check(enc.rc == ERR_NOT_REGULAR_FILE, "fd job on a pipe is refused");
+    close(pipe_fds[0]);
+    close(pipe_fds[1]);
+
+    prepare(&enc, JOB_RANGE, JOB_SRC_PATH);
+    check(ta152_submit(ctx, &enc) == ERR_INVALID_JOB, "range job on a path is refused");
+    ta152_async_destroy(ctx);
+
+    // one worker, depth 2: a held fd job runs while a buffer job waits in the queue
+    if (ta152_async_create(&ctx, 1, 2) < 0)
+        return EXIT_FAILURE;
+
+    struct Gate gate = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, 0, 0 };
+    struct AsyncJob held, queued, extra;
+    prepare(&held, JOB_ENCRYPT, JOB_SRC_FD);
+    held.in_fd = fileno(in);
+    held.out_fd = fileno(pt);
+    held.plan.buf_size = 4096;
+    held.plan.cancel = hold_first_buffer;
+    held.plan.cancel_ctx = &gate;
+    prepare(&queued, JOB_ENCRYPT, JOB_SRC_BUFFER);
+    queued.in_buf = plain;
+    queued.in_len = TEST_LEN;
+    queued.out_buf = cipher;
+    queued.out_cap = TEST_LEN + TA152_HEADER_SIZE;
+    extra = queued;
+
+    ta152_submit(ctx, &held);
+    ta152_submit(ctx, &queued);
+    check(ta152_submit(ctx, &extra) == ERR_QUEUE_FULL, "submit past depth is ERR_QUEUE_FULL");
+
+    pthread_mutex_lock(&gate.lock);
+    while (!gate.started)
+        pthread_cond_wait(&gate.cond, &gate.lock);
+    pthread_mutex_unlock(&gate.lock);
+
+    check(ta152_cancel(ctx, &queued) == CANCEL_DONE, "cancel queued job is CANCEL_DONE");
+    check(ta152_cancel(ctx, &held) == CANCEL_REQUESTED, "cancel running fd job is CANCEL_REQUESTED");
+
+    pthread_mutex_lock(&gate.lock);
+    gate.open = 1;
+    pthread_cond_broadcast(&gate.cond);
+    pthread_mutex_unlock(&gate.lock);
+
+    wait_reaped(ctx, reaped, 2);
+    check(queued.rc == ERR_CANCELLED, "cancelled queued job ends ERR_CANCELLED");
+    check(held.rc == ERR_CANCELLED, "cancelled fd job ends ERR_CANCELLED");
+    check(ta152_cancel(ctx, &held) == ERR_JOB_NOT_FOUND, "cancel finished job is ERR_JOB_NOT_FOUND");
+    ta152_async_destroy(ctx);
+
+    fclose(in);
+    fclose(ct);
+    fclose(pt);
+    fclose(raw);
+    free(plain);
+    free(cipher);
+    free(back);
+    free(ref);
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
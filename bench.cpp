@@ -0,0 +1,240 @@
+// benchmark and cross-check of the C++ front end (ta152.hpp) against the C engines
+// usage: ta152_bench [MiB]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <vector>
+#include "ta152.hpp"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+int failures = 0;
+
+void check(bool ok, const char *what) {
+    std::printf("%-44s %s\n", what, ok ? "ok" : "MISMATCH");
+    if (!ok)
+        failures++;
+}
+
+double mbps(std::size_t bytes, Clock::time_point start) {
+    double secs = std::chrono::duration<double>(Clock::now() - start).count();
+    return secs > 0 ? bytes / secs / 1e6 : 0;
+}
+
+std::vector<std::uint8_t> make_input(std::size_t len) {
+    std::vector<std::uint8_t> buf(len);
+    std::uint32_t x = 0x12345678;
+    for (auto &b : buf) {
+        x = x * 1664525 + 1013904223;
+        b = static_cast<std::uint8_t>(x >> 24);
+    }
+    return buf;
+}
+
+std::vector<std::uint8_t> c_run(int engine, int dir, int status, const ta152::Key &key, const ta152::Iv &iv,
+                                const std::vector<std::uint8_t> &in) {
+    std::vector<std::uint8_t> out(in.size());
+    auto *st = new CipherState;
+    ta152_state_init(st, key.data(), status, iv.data(), engine);
+    if (dir == DIR_ENCRYPT)
+        ta152_state_encrypt(st, in.data(), out.data(), in.size());
+    else
+        ta152_state_decrypt(st, in.data(), out.data(), in.size());
+    ta152_state_wipe(st);
+    delete st;
+    return out;
+}
+
+// feeds the cipher in uneven pieces so partial key cycles are exercised
+template <class C>
+std::vector<std::uint8_t> cpp_chunked(C cipher, const std::vector<std::uint8_t> &in) {
+    static const std::size_t sizes[] = { 1, 7, 16, 33, 4093, 15, 65536 };
+    std::vector<std::uint8_t> out(in.size());
+    std::size_t done = 0;
+    for (int i = 0; done < in.size(); i++) {
+        std::size_t n = sizes[i % 7];
+        if (n > in.size() - done)
+            n = in.size() - done;
+        cipher.update(std::span(in).subspan(done, n), std::span(out).subspan(done, n));
+        done += n;
+    }
+    return out;
+}
+
+// a toy event loop: every operation suspends and is resumed from the run queue
+struct Loop {
+    std::vector<std::coroutine_handle<>> ready;
+
+    void run() {
+        while (!ready.empty()) {
+            auto h = ready.back();
+            ready.pop_back();
+            h.resume();
+        }
+    }
+};
+
+struct MemoryStream {
+    Loop &loop;
+    const std::vector<std::uint8_t> *src;
+    std::vector<std::uint8_t> *dst;
+    std::size_t pos = 0;
+
+    struct ReadOp {
+        MemoryStream &s;
+        std::span<std::uint8_t> buf;
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> h) { s.loop.ready.push_back(h); }
+        std::size_t await_resume() {
+            std::size_t n = s.src->size() - s.pos;
+            if (n > buf.size())
+                n = buf.size();
+            std::memcpy(buf.data(), s.src->data() + s.pos, n);
+            s.pos += n;
+            return n;
+        }
+    };
+
+    struct WriteOp {
+        MemoryStream &s;
+        std::span<const std::uint8_t> buf;
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> h) { s.loop.ready.push_back(h); }
+        void await_resume() { s.dst->insert(s.dst->end(), buf.begin(), buf.end()); }
+    };
+
+    ReadOp read_some(std::span<std::uint8_t> buf) { return { *this, buf }; }
+    WriteOp write(std::span<const std::uint8_t> buf) { return { *this, buf }; }
+};
+
+struct Task {
+    struct promise_type {
+        Task get_return_object() { return Task{ std::coroutine_handle<promise_type>::from_promise(*this) }; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+
+    std::coroutine_handle<promise_type> h;
+
+    ~Task() {
+        if (h)
+            h.destroy();
+    }
+};
+
+// encrypts src into dst through an AsyncStream, reading plaintext with a plain stream
+Task pump_encrypt(MemoryStream &in, ta152::AsyncStream<ta152::Encryptor<ta152::IvMode::on>, MemoryStream> &out) {
+    std::array<std::uint8_t, 1000> buf;
+    while (std::size_t n = co_await in.read_some(buf))
+        co_await out.write(std::span(buf).first(n));
+}
+
+// decrypts through an AsyncStream on the read side
+Task pump_decrypt(ta152::AsyncStream<ta152::Decryptor<ta152::IvMode::on>, MemoryStream> &in, MemoryStream &out) {
+    std::array<std::uint8_t, 777> buf;
+    while (std::size_t n = co_await in.read_some(buf))
+        co_await out.write(std::span<const std::uint8_t>(buf).first(n));
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    std::size_t mib = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 16;
+    if (mib == 0)
+        mib = 1;
+    std::size_t len = mib * 1024 * 1024;
+
+    const ta152::Key key = { 0x3a, 0x91, 0x07, 0xc4, 0x5e, 0x12, 0xfd, 0x68,
+                             0x2b, 0xa0, 0x77, 0x01, 0xe9, 0x4c, 0xb3, 0x96 };
+    const ta152::Iv iv = { 0x10, 0x32, 0x54, 0x76, 0x98, 0xba, 0xdc, 0xfe,
+                           0x01, 0x23, 0x45, 0x67, 0x89, 0xab, 0xcd, 0xef };
+    const ta152::Iv zero_iv{};
+
+    // correctness against the reference per-round kernel
+    auto small = make_input(65536 + 5);
+    auto ref = c_run(ENGINE_SCALAR, DIR_ENCRYPT, STATUS_ON, key, iv, small);
+    check(cpp_chunked(ta152::Encryptor<ta152::IvMode::on>(key, iv), small) == ref, "encrypt, iv, vs C scalar");
+    check(cpp_chunked(ta152::Decryptor<ta152::IvMode::on>(key, iv), ref) == small, "decrypt, iv, round-trip");
+    ref = c_run(ENGINE_SCALAR, DIR_ENCRYPT, STATUS_OFF, key, zero_iv, small);
+    check(cpp_chunked(ta152::Encryptor<ta152::IvMode::off>(key), small) == ref, "encrypt, no iv, vs C scalar");
+    check(cpp_chunked(ta152::Decryptor<ta152::IvMode::off>(key), ref) == small, "decrypt, no iv, round-trip");
+
+    ta152::Encryptor<ta152::IvMode::on> moved_from(key, iv);
+    ta152::Encryptor<ta152::IvMode::on> moved(std::move(moved_from));
+    std::vector<std::uint8_t> out(small.size());
+    moved.update(small, out);
+    check(out == c_run(ENGINE_SCALAR, DIR_ENCRYPT, STATUS_ON, key, iv, small), "encrypt after move");
+
+    {
+        ta152::Encryptor<ta152::IvMode::off> enc(key);
+        std::vector<std::uint8_t> whole(small.size());
+        check(enc.update(small, whole) == small.size(), "update reports bytes processed");
+    }
+
+    auto hdr = ta152::make_header({ ta152::IvMode::on, iv, 1234 });
+    auto parsed = ta152::parse_header(hdr);
+    check(parsed && parsed->iv == iv && parsed->file_size == 1234 && parsed->mode == ta152::IvMode::on, "header round-trip");
+
+    // coroutine adaptor through a suspending event loop
+    {
+        Loop loop;
+        std::vector<std::uint8_t> cipher;
+        std::vector<std::uint8_t> plain;
+        MemoryStream src{ loop, &small, nullptr };
+        MemoryStream sink{ loop, nullptr, &cipher };
+        ta152::AsyncStream enc(ta152::Encryptor<ta152::IvMode::on>(key, iv), sink);
+        {
+            Task t = pump_encrypt(src, enc);
+            loop.run();
+        }
+        check(cipher == c_run(ENGINE_TABLE, DIR_ENCRYPT, STATUS_ON, key, iv, small), "async encrypt stream");
+
+        MemoryStream csrc{ loop, &cipher, nullptr };
+        MemoryStream psink{ loop, nullptr, &plain };
+        ta152::AsyncStream dec(ta152::Decryptor<ta152::IvMode::on>(key, iv), csrc);
+        {
+            Task t = pump_decrypt(dec, psink);
+            loop.run();
+        }
+        check(plain == small, "async decrypt stream");
+    }
+
+    // throughput
+    auto input = make_input(len);
+    std::vector<std::uint8_t> c_out(len);
+    std::vector<std::uint8_t> cpp_out(len);
+    std::printf("\n%zu MiB, IV mode on\n", mib);
+
+    auto *st = new CipherState;
+    ta152_state_init(st, key.data(), STATUS_ON, iv.data(), ENGINE_TABLE);
+    auto start = Clock::now();
+    ta152_state_encrypt(st, input.data(), c_out.data(), len);
+    std::printf("%-44s %8.2f MB/s\n", "C table engine, encrypt", mbps(len, start));
+    ta152_state_wipe(st);
+    delete st;
+
+    {
+        ta152::Encryptor<ta152::IvMode::on> enc(key, iv);
+        start = Clock::now();
+        enc.update(input, cpp_out);
+        std::printf("%-44s %8.2f MB/s\n", "C++ Encryptor<IvMode::on>", mbps(len, start));
+    }
+    check(cpp_out == c_out, "C++ output equals C output");
+
+    {
+        ta152::Decryptor<ta152::IvMode::on> dec(key, iv);
+        start = Clock::now();
+        dec.update(cpp_out);
+        std::printf("%-44s %8.2f MB/s\n", "C++ Decryptor<IvMode::on>, in place", mbps(len, start));
+    }
+    check(cpp_out == input, "C++ decrypt round-trip");
+
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
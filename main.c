@@ -1,10 +1,12 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <poll.h>
+#include <sys/stat.h>
 #include "ta152.h"
 
 static void usage (const char *prog) {
-    fprintf(stderr, "Usage:\nENCRYPTION: %s encrypt <input_file> <keyfile>\nDECRYPTION: %s decrypt <input_file> <keyfile>\nENCRYPTION WITH IV: %s encrypt <input_file> <keyfile> -iv\n", prog, prog, prog);
+    fprintf(stderr, "Usage:\nENCRYPTION: %s encrypt <input_file> <keyfile> [options]\nDECRYPTION: %s decrypt <input_file> <keyfile> [options]\nENCRYPTION WITH IV: %s encrypt <input_file> <keyfile> -iv [options]\nTREE ENCRYPTION: %s encrypt-tree <directory> <keyfile> [-iv] [--hash] [options]\nARCHIVE: %s archive <directory> <keyfile> [-iv] [options]\nEXTRACTION: %s extract <archive> <keyfile> [<member>] [options]\nBATCH: %s batch <encrypt|decrypt> <keyfile> <input_file>... [-iv] [options]\nTUNING: %s tune [<input_file>]\n\nOptions:\n  --engine <auto|scalar|table|pipelined>\n  --threads <n>\n  --io <read|mmap>\n", prog, prog, prog, prog, prog, prog, prog, prog);
 }
 
 // ta152.h defines return values for error codes
@@ -49,47 +51,290 @@ static void print_error(int error_code) {
         case ERR_UNSUPPORTED_VERSION:
             fprintf(stderr, "Error: unsupported file version\n");
             break;
+        case ERR_UNKNOWN_ENGINE:
+            fprintf(stderr, "Error: unknown engine or I/O backend\n");
+            break;
+        case ERR_NO_MEMORY:
+            fprintf(stderr, "Error: out of memory\n");
+            break;
+        case ERR_CALIBRATION_FAILED:
+            fprintf(stderr, "Error: calibration failed\n");
+            break;
+        case ERR_MEMBER_NOT_FOUND:
+            fprintf(stderr, "Error: member not found in archive\n");
+            break;
+        case ERR_QUEUE_FULL:
+            fprintf(stderr, "Error: job queue full\n");
+            break;
+        case ERR_CANCELLED:
+            fprintf(stderr, "Error: job cancelled\n");
+            break;
+        case ERR_JOB_NOT_FOUND:
+            fprintf(stderr, "Error: job not pending\n");
+            break;
+        case ERR_BUFFER_TOO_SMALL:
+            fprintf(stderr, "Error: output buffer too small\n");
+            break;
+        case ERR_INVALID_JOB:
+            fprintf(stderr, "Error: invalid job\n");
+            break;
+        case ERR_NOT_REGULAR_FILE:
+            fprintf(stderr, "Error: input is not a regular file\n");
+            break;
         default:
             fprintf(stderr, "Error: unknown error (%d)\n", error_code);
             break;
     }
 }
 
+static const char *io_name(int io) {
+    switch (io) {
+        case IO_READ:
+            return "read";
+        case IO_MMAP:
+            return "mmap";
+        default:
+            return "auto";
+    }
+}
+
+static int io_parse(const char *name) {
+    if (strcmp(name, "read") == 0)
+        return IO_READ;
+    if (strcmp(name, "mmap") == 0)
+        return IO_MMAP;
+    if (strcmp(name, "auto") == 0)
+        return IO_AUTO;
+    return -1;
+}
+
+// ta152 tune [<input_file>]: rerun calibration and report the plan for a job
+static int run_tune(const char *in_path, const struct EnginePlan *overrides) {
+    struct Calibration cal;
+    int rc = ta152_calibrate(&cal, 1);
+    if (rc < 0)
+        return rc;
+
+    char path[4096];
+    if (ta152_calibration_path(path, sizeof path) == 0)
+        printf("calibration: %s\n", path);
+    printf("cpus: %d\n", cal.nproc);
+    for (int i = ENGINE_AUTO + 1; i < ENGINE_COUNT; i++) {
+        double mbps = cal.byte_ns[i] > 0 ? 1e3 / cal.byte_ns[i] : 0;
+        printf("engine %-10s setup %10.0f ns  %10.2f MB/s\n", ta152_engine_name(i), cal.setup_ns[i], mbps);
+    }
+
+    long long job_size = 0;
+    if (in_path) {
+        struct stat st;
+        if (stat(in_path, &st) != 0)
+            return ERR_CANNOT_STAT_SIZE;
+        job_size = st.st_size;
+    }
+
+    struct EnginePlan plan;
+    rc = ta152_plan_job(&plan, job_size, overrides);
+    if (rc < 0)
+        return rc;
+
+    printf("job: %lld bytes -> engine %s, io %s, buffer %zu, threads %d\n",
+           job_size, ta152_engine_name(plan.engine), io_name(plan.io), plan.buf_size, plan.threads);
+    return 0;
+}
+
+#define BATCH_DEPTH 16
+#define BATCH_REAP 16
+
+static int batch_collect(struct AsyncContext *ctx, int *failed, int *rc) {
+    struct pollfd pfd = { ta152_async_fd(ctx), POLLIN, 0 };
+    poll(&pfd, 1, -1);
+
+    struct AsyncJob *done[BATCH_REAP];
+    int n = ta152_reap(ctx, done, BATCH_REAP);
+    for (int i = 0; i < n; i++) {
+        if (done[i]->rc < 0) {
+            fprintf(stderr, "%s: ", done[i]->in_path);
+            print_error(done[i]->rc);
+            (*failed)++;
+            *rc = done[i]->rc;
+        }
+    }
+    return n;
+}
+
+// ta152 batch <encrypt|decrypt> <keyfile> <file>...: one async job per file on a shared pool
+static int run_batch(int op, const char *key_file, const char **files, int count, int status_b, const struct EnginePlan *overrides) {
+    struct AsyncContext *ctx;
+    int rc = ta152_async_create(&ctx, overrides->threads, BATCH_DEPTH);
+    if (rc < 0)
+        return rc;
+
+    struct AsyncJob *jobs = calloc(count, sizeof *jobs);
+    if (!jobs) {
+        ta152_async_destroy(ctx);
+        return ERR_NO_MEMORY;
+    }
+
+    int submitted = 0;
+    int completed = 0;
+    int failed = 0;
+    rc = 0;
+    while (completed < count) {
+        while (submitted < count) {
+            struct AsyncJob *job = &jobs[submitted];
+            job->op = op;
+            job->src = JOB_SRC_PATH;
+            job->status = status_b;
+            job->in_path = files[submitted];
+            job->key_file = key_file;
+            job->plan = *overrides;
+            // --threads sizes the pool, each job stays on its worker
+            job->plan.threads = 0;
+
+            int submit_rc = ta152_submit(ctx, job);
+            if (submit_rc == ERR_QUEUE_FULL)
+                break;
+            if (submit_rc < 0) {
+                job->rc = submit_rc;
+                fprintf(stderr, "%s: ", job->in_path);
+                print_error(submit_rc);
+                failed++;
+                completed++;
+                rc = submit_rc;
+            }
+            submitted++;
+        }
+
+        if (completed < count)
+            completed += batch_collect(ctx, &failed, &rc);
+    }
+
+    printf("batch: %d files, %d failed\n", count, failed);
+    ta152_async_destroy(ctx);
+    free(jobs);
+    return rc;
+}
+
 int main(int argc, char *argv[]) {
     
-    if (argc > 5 || argc < 4) {
+    if (argc < 2) {
         usage(argv[0]);
         return EXIT_FAILURE;
     }
 
+    const char *mode = argv[1];
+    const char **positional = calloc(argc, sizeof *positional);
+    if (!positional) {
+        print_error(ERR_NO_MEMORY);
+        return EXIT_FAILURE;
+    }
+    int n_positional = 0;
     uint8_t status_bit = STATUS_OFF;
-    if (argc == 5) {
-        if (strcmp(argv[4], "-iv") == 0) {
+    struct EnginePlan overrides = {0};
+    int tree_flags = 0;
+
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "-iv") == 0) {
             status_bit = STATUS_ON;
         }
-        else {
-            fprintf(stderr, "Error: unknown option '-%s'\n", argv[4]);
+        else if (strcmp(argv[i], "--hash") == 0) {
+            tree_flags |= TREE_HASH;
+        }
+        else if (strcmp(argv[i], "--engine") == 0 && i + 1 < argc) {
+            int engine = ta152_engine_parse(argv[++i]);
+            if (engine < 0) {
+                fprintf(stderr, "Error: unknown engine '%s'\n", argv[i]);
+                usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+            overrides.engine = engine;
+        }
+        else if (strcmp(argv[i], "--io") == 0 && i + 1 < argc) {
+            int io = io_parse(argv[++i]);
+            if (io < 0) {
+                fprintf(stderr, "Error: unknown I/O backend '%s'\n", argv[i]);
+                usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+            overrides.io = io;
+        }
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            char *end;
+            long threads = strtol(argv[++i], &end, 10);
+            if (*end != '\0' || threads < 1 || threads > 1024) {
+                fprintf(stderr, "Error: invalid thread count '%s'\n", argv[i]);
+                usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+            overrides.threads = (int)threads;
+        }
+        else if (argv[i][0] == '-') {
+            fprintf(stderr, "Error: unknown option '%s'\n", argv[i]);
             usage(argv[0]);
             return EXIT_FAILURE;
         }
+        else {
+            positional[n_positional++] = argv[i];
+        }
     }
-    
-    const char *mode = argv[1];
-    const char *in_path = argv[2];
-    const char *key_path = argv[3];
-    
+
     int rc;
 
-    if (strcmp(mode, "encrypt") == 0) {
-        rc = ta152_encrypt(in_path, key_path, status_bit);
+    if (strcmp(mode, "tune") == 0) {
+        if (n_positional > 1 || status_bit == STATUS_ON) {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+        rc = run_tune(positional[0], &overrides);
+    }
+    else if (strcmp(mode, "extract") == 0) {
+        if (n_positional < 2 || n_positional > 3 || status_bit == STATUS_ON || tree_flags) {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+        struct TreeStats stats = {0};
+        rc = ta152_archive_extract(positional[0], positional[1], positional[2], &overrides, &stats);
+        printf("extract: %ld members (%lld bytes), %ld failed\n", stats.encrypted, stats.bytes, stats.failed);
+    }
+    else if (strcmp(mode, "batch") == 0) {
+        int op = n_positional >= 1 && strcmp(positional[0], "encrypt") == 0 ? JOB_ENCRYPT
+               : n_positional >= 1 && strcmp(positional[0], "decrypt") == 0 ? JOB_DECRYPT : 0;
+        if (n_positional < 3 || op == 0 || tree_flags || (op == JOB_DECRYPT && status_bit == STATUS_ON)) {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+        rc = run_batch(op, positional[1], positional + 2, n_positional - 2, status_bit, &overrides);
+    }
+    else if (n_positional != 2) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    else if (tree_flags && strcmp(mode, "encrypt-tree") != 0) {
+        fprintf(stderr, "Error: --hash is only valid for encrypt-tree\n");
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    else if (strcmp(mode, "archive") == 0) {
+        struct TreeStats stats = {0};
+        rc = ta152_archive_create(positional[0], positional[1], status_bit, &overrides, &stats);
+        printf("archive: %ld members (%lld bytes), %ld failed\n", stats.encrypted, stats.bytes, stats.failed);
+    }
+    else if (strcmp(mode, "encrypt-tree") == 0) {
+        struct TreeStats stats = {0};
+        rc = ta152_encrypt_tree(positional[0], positional[1], status_bit, tree_flags, &overrides, &stats);
+        printf("tree: %ld files, %ld encrypted (%lld bytes), %ld unchanged, %ld failed\n",
+               stats.files, stats.encrypted, stats.bytes, stats.unchanged, stats.failed);
+    }
+    else if (strcmp(mode, "encrypt") == 0) {
+        rc = ta152_encrypt_plan(positional[0], positional[1], status_bit, &overrides);
     }
     else if (strcmp(mode, "decrypt") == 0) {
-        if (argc > 4) {
-            fprintf(stderr, "Error: decrypt does not accept arguments\n");
+        if (status_bit == STATUS_ON) {
+            fprintf(stderr, "Error: decrypt does not accept -iv\n");
             usage(argv[0]);
             return EXIT_FAILURE;
         }
-        rc = ta152_decrypt(in_path, key_path);
+        rc = ta152_decrypt_plan(positional[0], positional[1], &overrides);
     }
     else {
         fprintf(stderr, "Error: unknown mode '%s'\n", mode);
@@ -0,0 +1,330 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "ta152.h"
+
+// the pipelined engine splits the stream into blocks of PIPELINE_BLOCK bytes; helper h of H
+// produces the keystream of blocks h, h + H, ... into its own single-producer single-consumer
+// ring, one byte per data byte; the consumer runs the feedback chain and advances the cycle
+// power in the state itself, as the table kernel does
+#define PIPELINE_BLOCK 4096
+#define PIPELINE_DEPTH 4
+// polls before a side parks on its helper's condvar
+#define PIPELINE_SPINS 1024
+
+struct PipelineBlock {
+    uint8_t ks[PIPELINE_BLOCK];
+};
+
+// S' = a * S + b (mod 256)
+struct Affine {
+    uint8_t a;
+    uint8_t b;
+};
+
+struct Helper {
+    struct PipelineBlock slots[PIPELINE_DEPTH];
+    _Alignas(64) atomic_size_t head;
+    _Alignas(64) atomic_size_t tail;
+    // threads parked on cond, the producer waiting for room or the consumer for a block
+    atomic_int waiters;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    struct Pipeline *pl;
+    int index;
+    pthread_t tid;
+};
+
+struct Pipeline {
+    const struct CipherState *st;
+    int dir;
+    int helpers;
+    atomic_int stop;
+    struct Helper *helper;
+    size_t block;
+    size_t pos;
+    const struct PipelineBlock *cur;
+};
+
+static struct Affine affine_then(struct Affine f, struct Affine g) {
+    struct Affine r = { (uint8_t)(g.a * f.a), (uint8_t)(g.a * f.b + g.b) };
+    return r;
+}
+
+static struct Affine affine_pow(struct Affine f, size_t e) {
+    struct Affine r = { 1, 0 };
+    while (e) {
+        if (e & 1)
+            r = affine_then(r, f);
+        f = affine_then(f, f);
+        e >>= 1;
+    }
+    return r;
+}
+
+// keystream over 256 steps from a counter aligned to 256, identical for every such run
+static struct Affine keystream_chunk(const uint8_t key[KEY_SIZE]) {
+    struct Affine f = { 1, 0 };
+    for (int n = 0; n < 256; n++) {
+        struct Affine step = { 131, (uint8_t)(key[n % KEY_SIZE] + n) };
+        f = affine_then(f, step);
+    }
+    return f;
+}
+
+// out = p o q
+static void perm_compose(uint8_t out[MATRIX_LEN], const uint8_t p[MATRIX_LEN], const uint8_t q[MATRIX_LEN]) {
+    uint8_t tmp[MATRIX_LEN];
+    for (int i = 0; i < MATRIX_LEN; i++)
+        tmp[i] = p[q[i]];
+    memcpy(out, tmp, MATRIX_LEN);
+}
+
+// publishing a ring index and testing waiters are both seq_cst, so either the parked side
+// sees the new index before it sleeps or the publisher sees it parked and wakes it
+static void wake(struct Helper *h) {
+    if (atomic_load(&h->waiters) > 0) {
+        pthread_mutex_lock(&h->lock);
+        pthread_cond_broadcast(&h->cond);
+        pthread_mutex_unlock(&h->lock);
+    }
+}
+
+static int ring_full(struct Helper *h, size_t produced) {
+    return produced - atomic_load(&h->tail) == PIPELINE_DEPTH;
+}
+
+static int ring_empty(struct Helper *h, size_t seq) {
+    return atomic_load(&h->head) <= seq;
+}
+
+// returns 0 once there is room for block produced, 1 if the pipeline is stopping
+static int wait_room(struct Helper *h, size_t produced) {
+    struct Pipeline *pl = h->pl;
+
+    for (int spins = 0; spins < PIPELINE_SPINS; spins++) {
+        if (atomic_load_explicit(&pl->stop, memory_order_relaxed))
+            return 1;
+        if (!ring_full(h, produced))
+            return 0;
+    }
+
+    pthread_mutex_lock(&h->lock);
+    atomic_fetch_add(&h->waiters, 1);
+    while (ring_full(h, produced) && !atomic_load(&pl->stop))
+        pthread_cond_wait(&h->cond, &h->lock);
+    atomic_fetch_sub(&h->waiters, 1);
+    pthread_mutex_unlock(&h->lock);
+    return atomic_load(&pl->stop) != 0;
+}
+
+static void wait_block(struct Helper *h, size_t seq) {
+    for (int spins = 0; spins < PIPELINE_SPINS; spins++) {
+        if (!ring_empty(h, seq))
+            return;
+    }
+
+    pthread_mutex_lock(&h->lock);
+    atomic_fetch_add(&h->waiters, 1);
+    while (ring_empty(h, seq))
+        pthread_cond_wait(&h->cond, &h->lock);
+    atomic_fetch_sub(&h->waiters, 1);
+    pthread_mutex_unlock(&h->lock);
+}
+
+static void *helper_main(void *arg) {
+    struct Helper *h = arg;
+    struct Pipeline *pl = h->pl;
+    const struct CipherState *st = pl->st;
+    int stride = pl->helpers;
+
+    struct Affine chunk = keystream_chunk(st->key);
+    struct Affine ks_jump = affine_pow(chunk, (size_t)(stride - 1) * (PIPELINE_BLOCK / 256));
+    uint8_t S = 0;
+    if (st->status == STATUS_ON) {
+        struct Affine start = affine_pow(chunk, (size_t)h->index * (PIPELINE_BLOCK / 256));
+        S = (uint8_t)(start.a * st->S + start.b);
+    }
+
+    size_t produced = 0;
+    while (1) {
+        if (wait_room(h, produced))
+            return NULL;
+
+        struct PipelineBlock *blk = &h->slots[produced % PIPELINE_DEPTH];
+
+        if (st->status == STATUS_ON) {
+            for (int i = 0; i < PIPELINE_BLOCK; i++) {
+                blk->ks[i] = S;
+                S = (uint8_t)(S * 131 + st->key[i % KEY_SIZE] + (i & 0xFF));
+            }
+            S = (uint8_t)(ks_jump.a * S + ks_jump.b);
+        }
+        else {
+            memset(blk->ks, 0, PIPELINE_BLOCK);
+        }
+
+        produced++;
+        atomic_store(&h->head, produced);
+        wake(h);
+    }
+}
+
+static const struct PipelineBlock *next_block(struct Pipeline *pl) {
+    struct Helper *h = &pl->helper[pl->block % pl->helpers];
+    size_t seq = pl->block / pl->helpers;
+
+    wait_block(h, seq);
+    return &h->slots[seq % PIPELINE_DEPTH];
+}
+
+static void release_block(struct Pipeline *pl) {
+    struct Helper *h = &pl->helper[pl->block % pl->helpers];
+    size_t seq = pl->block / pl->helpers;
+
+    atomic_store(&h->tail, seq + 1);
+    wake(h);
+    pl->cur = NULL;
+    pl->pos = 0;
+    pl->block++;
+}
+
+// in and out may alias
+void ta152_pipeline_process(struct CipherState *st, const uint8_t *in, uint8_t *out, size_t len) {
+    struct Pipeline *pl = st->pipeline;
+    uint8_t mix_byte = st->mix_byte;
+
+    while (len > 0) {
+        if (!pl->cur)
+            pl->cur = next_block(pl);
+
+        const struct PipelineBlock *blk = pl->cur;
+        size_t pos = pl->pos;
+        size_t n = PIPELINE_BLOCK - pos;
+        if (n > len)
+            n = len;
+
+        // blocks hold whole key cycles, so pos % KEY_SIZE is the key position
+        if (pl->dir == DIR_ENCRYPT) {
+            for (size_t i = 0; i < n; i++, pos++) {
+                uint8_t cipher = st->cycle_mx[st->prefix_mx[pos % KEY_SIZE][in[i] ^ mix_byte]] ^ blk->ks[pos];
+                out[i] = cipher;
+                mix_byte = cipher;
+                if (pos % KEY_SIZE == KEY_SIZE - 1)
+                    perm_compose(st->cycle_mx, st->cycle_mx, st->prefix_mx[KEY_SIZE - 1]);
+            }
+        }
+        else {
+            for (size_t i = 0; i < n; i++, pos++) {
+                uint8_t cipher = in[i];
+                out[i] = st->prefix_inv[pos % KEY_SIZE][st->cycle_inv[cipher ^ blk->ks[pos]]] ^ mix_byte;
+                mix_byte = cipher;
+                if (pos % KEY_SIZE == KEY_SIZE - 1)
+                    perm_compose(st->cycle_inv, st->prefix_inv[KEY_SIZE - 1], st->cycle_inv);
+            }
+        }
+
+        pl->pos = pos;
+        in += n;
+        out += n;
+        len -= n;
+
+        if (pl->pos == PIPELINE_BLOCK)
+            release_block(pl);
+    }
+
+    st->mix_byte = mix_byte;
+}
+
+static void stop_helpers(struct Pipeline *pl) {
+    atomic_store(&pl->stop, 1);
+    for (int i = 0; i < pl->helpers; i++) {
+        struct Helper *h = &pl->helper[i];
+        pthread_mutex_lock(&h->lock);
+        pthread_cond_broadcast(&h->cond);
+        pthread_mutex_unlock(&h->lock);
+    }
+
+    for (int i = 0; i < pl->helpers; i++)
+        pthread_join(pl->helper[i].tid, NULL);
+}
+
+// attaches helper threads to a freshly initialized state; on failure the state
+// keeps running on the table kernel
+int ta152_pipeline_start(struct CipherState *st, int dir, int helpers) {
+    if (st->engine != ENGINE_PIPELINED || st->pipeline || st->keypos != 0 || st->counter != 0)
+        return ERR_UNKNOWN_ENGINE;
+
+    if (helpers < 1)
+        helpers = 1;
+    if (helpers > PIPELINE_MAX_HELPERS)
+        helpers = PIPELINE_MAX_HELPERS;
+
+    struct Pipeline *pl = calloc(1, sizeof *pl);
+    if (!pl)
+        return ERR_NO_MEMORY;
+
+    size_t helper_size = (helpers * sizeof(struct Helper) + 63) & ~(size_t)63;
+    pl->helper = aligned_alloc(64, helper_size);
+    if (!pl->helper) {
+        free(pl);
+        return ERR_NO_MEMORY;
+    }
+
+    pl->st = st;
+    pl->dir = dir;
+    pl->helpers = helpers;
+    atomic_init(&pl->stop, 0);
+
+    for (int i = 0; i < helpers; i++) {
+        struct Helper *h = &pl->helper[i];
+        atomic_init(&h->head, 0);
+        atomic_init(&h->tail, 0);
+        atomic_init(&h->waiters, 0);
+        pthread_mutex_init(&h->lock, NULL);
+        pthread_cond_init(&h->cond, NULL);
+        h->pl = pl;
+        h->index = i;
+    }
+
+    int started = 0;
+    for (; started < helpers; started++) {
+        if (pthread_create(&pl->helper[started].tid, NULL, helper_main, &pl->helper[started]) != 0)
+            break;
+    }
+
+    if (started < helpers) {
+        pl->helpers = started;
+        stop_helpers(pl);
+        for (int i = 0; i < helpers; i++) {
+            pthread_mutex_destroy(&pl->helper[i].lock);
+            pthread_cond_destroy(&pl->helper[i].cond);
+        }
+        free(pl->helper);
+        free(pl);
+        return ERR_NO_MEMORY;
+    }
+
+    st->pipeline = pl;
+    return 0;
+}
+
+void ta152_pipeline_stop(struct CipherState *st) {
+    struct Pipeline *pl = st->pipeline;
+    if (!pl)
+        return;
+
+    stop_helpers(pl);
+    for (int i = 0; i < pl->helpers; i++) {
+        pthread_mutex_destroy(&pl->helper[i].lock);
+        pthread_cond_destroy(&pl->helper[i].cond);
+    }
+
+    explicit_bzero(pl->helper, pl->helpers * sizeof(struct Helper));
+    free(pl->helper);
+    free(pl);
+    st->pipeline = NULL;
+}
@@ -6,6 +6,7 @@
 #include <stddef.h>
 #include <unistd.h>
 #include <sys/random.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include "ta152.h"
 
@@ -258,7 +259,443 @@ uint8_t ta152_decrypt_chunk(uint8_t input_chunk, uint8_t key_byte, uint8_t *base
     return *(inverse_mx + pos);
 }
 
+// one full key cycle of rounds starting from identity, snapshotted after every round
+static void init_cycle_tables(struct CipherState *st) {
+    uint8_t base_mx[MATRIX_LEN];
+    uint8_t inverse_mx[MATRIX_LEN];
+
+    init_matrix(base_mx);
+    init_matrix(inverse_mx);
+
+    for (int j = 0; j < KEY_SIZE; j++) {
+        ta152_round(st->key[j], base_mx, inverse_mx);
+        memcpy(st->prefix_mx[j], base_mx, MATRIX_LEN);
+        memcpy(st->prefix_inv[j], inverse_mx, MATRIX_LEN);
+    }
+
+    init_matrix(st->cycle_mx);
+    init_matrix(st->cycle_inv);
+}
+
+// cycle_mx = cycle_mx o Q, where Q is the permutation of one full key cycle
+static void advance_cycle_mx(struct CipherState *st) {
+    const uint8_t *q = st->prefix_mx[KEY_SIZE - 1];
+    uint8_t next[MATRIX_LEN];
+
+    for (int i = 0; i < MATRIX_LEN; i++)
+        next[i] = st->cycle_mx[q[i]];
+    memcpy(st->cycle_mx, next, MATRIX_LEN);
+}
+
+// cycle_inv = Q^-1 o cycle_inv
+static void advance_cycle_inv(struct CipherState *st) {
+    const uint8_t *q_inv = st->prefix_inv[KEY_SIZE - 1];
+
+    for (int i = 0; i < MATRIX_LEN; i++)
+        st->cycle_inv[i] = q_inv[st->cycle_inv[i]];
+}
+
+void ta152_state_init(struct CipherState *st, const uint8_t key[KEY_SIZE], int status, const uint8_t iv[IV_SIZE], int engine) {
+    st->engine = (engine == ENGINE_SCALAR || engine == ENGINE_PIPELINED) ? engine : ENGINE_TABLE;
+    st->pipeline = NULL;
+    st->status = status;
+    st->keypos = 0;
+    memcpy(st->key, key, KEY_SIZE);
+
+    st->S = 0;
+    st->counter = 0;
+    st->mix_byte = key[0];
+
+    if (status == STATUS_ON) {
+        st->S = key[0] ^ iv[0] ^ iv[1];
+        st->mix_byte = key[0] ^ iv[15];
+    }
+
+    init_matrix(st->base_mx);
+    init_matrix(st->inverse_mx);
+
+    if (st->engine != ENGINE_SCALAR)
+        init_cycle_tables(st);
+}
+
+void ta152_state_wipe(struct CipherState *st) {
+    explicit_bzero(st, sizeof *st);
+}
+
+static void scalar_encrypt(struct CipherState *st, const uint8_t *in, uint8_t *out, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        uint8_t cipher_buffer = in[i] ^ st->mix_byte;
+        uint8_t cipher =
+            ta152_encrypt_chunk(cipher_buffer, st->key[st->keypos], st->base_mx, st->inverse_mx);
+        if (st->status == STATUS_ON)
+            cipher = cipher ^ st->S;
+
+        out[i] = cipher;
+        st->mix_byte = cipher;
+
+        if (st->status == STATUS_ON) {
+            st->S = keystream_update(st->S, st->key[st->keypos], st->counter++);
+        }
+        st->keypos = (st->keypos + 1) % KEY_SIZE;
+    }
+}
+
+static void scalar_decrypt(struct CipherState *st, const uint8_t *in, uint8_t *out, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        uint8_t cipher = in[i];
+        uint8_t plain_buffer = cipher;
+        if (st->status == STATUS_ON)
+            plain_buffer = plain_buffer ^ st->S;
+
+        uint8_t plain =
+            ta152_decrypt_chunk(plain_buffer, st->key[st->keypos], st->base_mx, st->inverse_mx);
+
+        out[i] = plain ^ st->mix_byte;
+        st->mix_byte = cipher;
+
+        if (st->status == STATUS_ON) {
+            st->S = keystream_update(st->S, st->key[st->keypos], st->counter++);
+        }
+        st->keypos = (st->keypos + 1) % KEY_SIZE;
+    }
+}
+
+static void table_encrypt(struct CipherState *st, const uint8_t *in, uint8_t *out, size_t len) {
+    uint8_t mix_byte = st->mix_byte;
+    uint8_t S = st->S;
+    uint32_t counter = st->counter;
+    int keypos = st->keypos;
+
+    for (size_t i = 0; i < len; i++) {
+        uint8_t cipher = st->cycle_mx[st->prefix_mx[keypos][in[i] ^ mix_byte]];
+        if (st->status == STATUS_ON) {
+            cipher = cipher ^ S;
+            S = keystream_update(S, st->key[keypos], counter++);
+        }
+
+        out[i] = cipher;
+        mix_byte = cipher;
+
+        if (++keypos == KEY_SIZE) {
+            keypos = 0;
+            advance_cycle_mx(st);
+        }
+    }
+
+    st->mix_byte = mix_byte;
+    st->S = S;
+    st->counter = counter;
+    st->keypos = keypos;
+}
+
+static void table_decrypt(struct CipherState *st, const uint8_t *in, uint8_t *out, size_t len) {
+    uint8_t mix_byte = st->mix_byte;
+    uint8_t S = st->S;
+    uint32_t counter = st->counter;
+    int keypos = st->keypos;
+
+    for (size_t i = 0; i < len; i++) {
+        uint8_t cipher = in[i];
+        uint8_t plain_buffer = cipher;
+        if (st->status == STATUS_ON) {
+            plain_buffer = plain_buffer ^ S;
+            S = keystream_update(S, st->key[keypos], counter++);
+        }
+
+        out[i] = st->prefix_inv[keypos][st->cycle_inv[plain_buffer]] ^ mix_byte;
+        mix_byte = cipher;
+
+        if (++keypos == KEY_SIZE) {
+            keypos = 0;
+            advance_cycle_inv(st);
+        }
+    }
+
+    st->mix_byte = mix_byte;
+    st->S = S;
+    st->counter = counter;
+    st->keypos = keypos;
+}
+
+// in and out may alias
+void ta152_state_encrypt(struct CipherState *st, const uint8_t *in, uint8_t *out, size_t len) {
+    if (st->engine == ENGINE_SCALAR)
+        scalar_encrypt(st, in, out, len);
+    else if (st->pipeline)
+        ta152_pipeline_process(st, in, out, len);
+    else
+        table_encrypt(st, in, out, len);
+}
+
+// in and out may alias
+void ta152_state_decrypt(struct CipherState *st, const uint8_t *in, uint8_t *out, size_t len) {
+    if (st->engine == ENGINE_SCALAR)
+        scalar_decrypt(st, in, out, len);
+    else if (st->pipeline)
+        ta152_pipeline_process(st, in, out, len);
+    else
+        table_decrypt(st, in, out, len);
+}
+
+static void state_process(struct CipherState *st, int dir, uint8_t *buf, size_t len) {
+    if (dir == DIR_ENCRYPT)
+        ta152_state_encrypt(st, buf, buf, len);
+    else
+        ta152_state_decrypt(st, buf, buf, len);
+}
+
+static int cancelled(const struct EnginePlan *job) {
+    return job->cancel && job->cancel(job->cancel_ctx);
+}
+
+// read backend, processes in place through one buffer; limit < 0 runs until EOF
+static int stream_read(struct CipherState *st, int dir, int in_fd, int out_fd, long long limit, const struct EnginePlan *job) {
+    size_t buf_size = job->buf_size;
+    uint8_t *buf = malloc(buf_size);
+    if (!buf)
+        return ERR_NO_MEMORY;
+
+    while (limit != 0) {
+        if (cancelled(job)) {
+            explicit_bzero(buf, buf_size);
+            free(buf);
+            return ERR_CANCELLED;
+        }
+
+        size_t to_read = buf_size;
+        if (limit > 0 && (long long)to_read > limit)
+            to_read = (size_t)limit;
+
+        ssize_t bytes_read = read(in_fd, buf, to_read);
+
+        if (bytes_read == 0) {
+            // a file that shrank under us no longer matches the size in its header
+            if (limit > 0) {
+                explicit_bzero(buf, buf_size);
+                free(buf);
+                return ERR_NO_READ;
+            }
+            break; //EOF
+        }
+
+        if (bytes_read < 0) {
+            explicit_bzero(buf, buf_size);
+            free(buf);
+            return ERR_NO_READ;
+        }
+
+        if (limit > 0)
+            limit -= bytes_read;
+
+        state_process(st, dir, buf, (size_t)bytes_read);
+
+        if (write_all(out_fd, buf, (size_t)bytes_read) < 0) {
+            explicit_bzero(buf, buf_size);
+            free(buf);
+            return ERR_NO_WRITE;
+        }
+    }
+
+    explicit_bzero(buf, buf_size);
+    free(buf);
+    return 0;
+}
+
+// mmap backend, maps the input once and writes out through one buffer
+// the input must not be truncated while mapped
+static int stream_mmap(struct CipherState *st, int dir, int in_fd, int out_fd, size_t offset, size_t len, const struct EnginePlan *job) {
+    size_t buf_size = job->buf_size;
+    if (len == 0)
+        return 0;
+
+    uint8_t *map = mmap(NULL, offset + len, PROT_READ, MAP_PRIVATE, in_fd, 0);
+    if (map == MAP_FAILED)
+        return ERR_NO_READ;
+    madvise(map, offset + len, MADV_SEQUENTIAL);
+
+    uint8_t *buf = malloc(buf_size);
+    if (!buf) {
+        munmap(map, offset + len);
+        return ERR_NO_MEMORY;
+    }
+
+    const uint8_t *in = map + offset;
+    size_t done = 0;
+    int rc = 0;
+    while (done < len) {
+        if (cancelled(job)) {
+            rc = ERR_CANCELLED;
+            break;
+        }
+
+        size_t n = min_ssize(len - done, buf_size);
+
+        if (dir == DIR_ENCRYPT)
+            ta152_state_encrypt(st, in + done, buf, n);
+        else
+            ta152_state_decrypt(st, in + done, buf, n);
+
+        if (write_all(out_fd, buf, n) < 0) {
+            rc = ERR_NO_WRITE;
+            break;
+        }
+        done += n;
+    }
+
+    explicit_bzero(buf, buf_size);
+    free(buf);
+    munmap(map, offset + len);
+    return rc;
+}
+
+static int run_plan(struct CipherState *st, int dir, int in_fd, int out_fd, size_t offset, long long limit, uint32_t size, const struct EnginePlan *job) {
+    // the caller's thread runs the feedback chain, the rest of the budget generates state;
+    // without a spare thread the state stays on the table kernel
+    if (job->engine == ENGINE_PIPELINED && job->threads > 1)
+        ta152_pipeline_start(st, dir, job->threads - 1);
+
+    int rc;
+    if (job->io == IO_MMAP)
+        rc = stream_mmap(st, dir, in_fd, out_fd, offset, size, job);
+    else
+        rc = stream_read(st, dir, in_fd, out_fd, limit, job);
+
+    ta152_pipeline_stop(st);
+    return rc;
+}
+
+// header as written in front of every payload, status must be STATUS_ON or STATUS_OFF
+void ta152_header_encode(uint8_t out[TA152_HEADER_SIZE], int status, const uint8_t iv[IV_SIZE], uint32_t file_size) {
+    struct Header hdr = {0};
+    hdr.version = VERSION;
+    hdr.status = (uint8_t)status;
+    if (status == STATUS_ON)
+        memcpy(hdr.iv, iv, IV_SIZE);
+    hdr.file_size = file_size;
+    write_header(out, &hdr);
+}
+
+int ta152_header_decode(const uint8_t in[TA152_HEADER_SIZE], int *status, uint8_t iv[IV_SIZE], uint32_t *file_size) {
+    struct Header hdr = {0};
+    uint8_t bytes[TA152_HEADER_SIZE];
+    memcpy(bytes, in, TA152_HEADER_SIZE);
+    read_header(&hdr, bytes);
+
+    int header_checker = verify_header(&hdr);
+    if (header_checker < 0)
+        return header_checker;
+
+    *status = hdr.status;
+    memcpy(iv, hdr.iv, IV_SIZE);
+    *file_size = hdr.file_size;
+    return 0;
+}
+
+// the header records the payload size up front, so pipes and sockets are refused
+static int check_regular(int fd) {
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+        return ERR_CANNOT_STAT_SIZE;
+    if (!S_ISREG(st.st_mode))
+        return ERR_NOT_REGULAR_FILE;
+    return 0;
+}
+
+// fd variants of ta152_encrypt/ta152_decrypt for callers that already hold the key;
+// in_fd must be a regular file and is processed from offset 0, out_fd is written at its
+// current position
+int ta152_encrypt_fd(int in_fd, int out_fd, const uint8_t key[KEY_SIZE], int status_b, const struct EnginePlan *plan) {
+    int regular_rc = check_regular(in_fd);
+    if (regular_rc < 0)
+        return regular_rc;
+
+    struct Header hdr = {0};
+    if (init_header(&hdr, in_fd, status_b) < 0)
+        return ERR_CANNOT_INIT_HEADER;
+
+    struct EnginePlan job;
+    int plan_rc = ta152_plan_job(&job, hdr.file_size, plan);
+    if (plan_rc < 0)
+        return plan_rc;
+
+    if (job.io == IO_READ && lseek(in_fd, 0, SEEK_SET) != 0)
+        return ERR_NO_READ;
+
+    uint8_t hdr_bytes[TA152_HEADER_SIZE];
+    write_header(hdr_bytes, &hdr);
+    if (write_all(out_fd, hdr_bytes, TA152_HEADER_SIZE) < 0)
+        return ERR_NO_WRITE;
+
+    struct CipherState st;
+    ta152_state_init(&st, key, hdr.status, hdr.iv, job.engine);
+    int stream_rc = run_plan(&st, DIR_ENCRYPT, in_fd, out_fd, 0, hdr.file_size, hdr.file_size, &job);
+    ta152_state_wipe(&st);
+
+    if (stream_rc < 0)
+        return stream_rc;
+    return SUCCESS_ENCRYPT;
+}
+
+int ta152_decrypt_fd(int in_fd, int out_fd, const uint8_t key[KEY_SIZE], const struct EnginePlan *plan) {
+    int regular_rc = check_regular(in_fd);
+    if (regular_rc < 0)
+        return regular_rc;
+
+    struct Header hdr = {0};
+    uint8_t hdr_bytes[TA152_HEADER_SIZE];
+
+    if (pread(in_fd, hdr_bytes, TA152_HEADER_SIZE, 0) != TA152_HEADER_SIZE)
+        return ERR_NO_READ;
+    read_header(&hdr, hdr_bytes);
+
+    int header_checker;
+    if ((header_checker = verify_header(&hdr)) < 0)
+        return header_checker;
+
+    long long in_file_size = filesize_fd(in_fd);
+    if (in_file_size < 0)
+        return ERR_CANNOT_STAT_SIZE;
+    if (in_file_size - TA152_HEADER_SIZE != hdr.file_size)
+        return ERR_HEADER_INVALID;
+
+    struct EnginePlan job;
+    int plan_rc = ta152_plan_job(&job, hdr.file_size, plan);
+    if (plan_rc < 0)
+        return plan_rc;
+
+    if (job.io == IO_READ && lseek(in_fd, TA152_HEADER_SIZE, SEEK_SET) != TA152_HEADER_SIZE)
+        return ERR_NO_READ;
+
+    struct CipherState st;
+    ta152_state_init(&st, key, hdr.status, hdr.iv, job.engine);
+    int stream_rc = run_plan(&st, DIR_DECRYPT, in_fd, out_fd, TA152_HEADER_SIZE, hdr.file_size, hdr.file_size, &job);
+    ta152_state_wipe(&st);
+
+    if (stream_rc < 0)
+        return stream_rc;
+    return SUCCESS_DECRYPT;
+}
+
+// read exactly KEY_SIZE bytes from key_file
+int ta152_load_key(const char *key_file, uint8_t key[KEY_SIZE]) {
+    int key_d = fd_open_read(key_file);
+    if (key_d < 0)
+        return ERR_OPEN_FAILED;
+
+    ssize_t key_bytes = fd_read(key_d, key, KEY_SIZE);
+    fd_close(key_d);
+    if (key_bytes != KEY_SIZE) {
+        explicit_bzero(key, KEY_SIZE);
+        return ERR_INVALID_KEY_SIZE;
+    }
+    return 0;
+}
+
 int ta152_encrypt(const char *in_path, const char *key_file, int status_b) {
+    return ta152_encrypt_plan(in_path, key_file, status_b, NULL);
+}
+
+int ta152_encrypt_plan(const char *in_path, const char *key_file, int status_b, const struct EnginePlan *plan) {
     if (!(status_b == STATUS_ON || status_b == STATUS_OFF))
         return ERR_UNDEFINED_STATUS;
 
@@ -274,13 +711,6 @@ int ta152_encrypt(const char *in_path, const char *key_file, int status_b) {
         free(out_path);
         return ERR_KEY_NOT_LOADED;
     }
-    int keypos = 0;
-
-    uint8_t base_mx[MATRIX_LEN];
-    uint8_t inverse_mx[MATRIX_LEN];
-
-    init_matrix(base_mx);
-    init_matrix(inverse_mx);
 
     int in_file = fd_open_read(in_path);
     if (in_file < 0) {
@@ -332,6 +762,17 @@ int ta152_encrypt(const char *in_path, const char *key_file, int status_b) {
         return ERR_CANNOT_INIT_HEADER;
     }
 
+    struct EnginePlan job;
+    int plan_rc = ta152_plan_job(&job, hdr.file_size, plan);
+    if (plan_rc < 0) {
+        fd_close(in_file);
+        fd_close(out_file);
+        free(out_path);
+        explicit_bzero(key_mx, KEY_SIZE); 
+        free(key_mx);
+        return plan_rc;
+    }
+
     uint8_t hdr_bytes[TA152_HEADER_SIZE];
     write_header(hdr_bytes, &hdr);
     if (write_all(out_file, hdr_bytes, TA152_HEADER_SIZE) < 0) {
@@ -343,88 +784,28 @@ int ta152_encrypt(const char *in_path, const char *key_file, int status_b) {
         return ERR_NO_WRITE;
     }
 
-    uint8_t S = 0;
-    uint32_t counter = 0;
+    struct CipherState st;
+    ta152_state_init(&st, key_mx, hdr.status, hdr.iv, job.engine);
 
-    if (status_b == STATUS_ON) {
-        S = key_mx[0] ^ hdr.iv[0] ^ hdr.iv[1];
-        counter = (uint32_t) 0;
-    }
-    
-    uint8_t inbuf[4096];
-    uint8_t outbuf[4096];
-    size_t outpos = 0;
-    
-    uint8_t mix_byte = key_mx[0];   
-    if (hdr.status == STATUS_ON)
-        mix_byte = key_mx[0] ^ hdr.iv[15];
-
-    while (1) {
-        ssize_t bytes_read = read(in_file, inbuf, sizeof inbuf);
-
-        if (bytes_read == 0) {
-            break; //EOF
-        }
-
-        if (bytes_read < 0) {
-            explicit_bzero(key_mx, KEY_SIZE);
-            free(key_mx);
-            free(out_path);
-            fd_close(in_file);
-            fd_close(out_file);           
-            return ERR_NO_READ;
-        }
-
-        for (ssize_t i = 0; i < bytes_read; i++) {
-            uint8_t cipher_buffer = inbuf[i] ^ mix_byte;
-            uint8_t cipher =
-                ta152_encrypt_chunk(cipher_buffer, key_mx[keypos], base_mx, inverse_mx);
-            if (status_b == STATUS_ON)
-                cipher = cipher ^ S;
-
-            outbuf[outpos++] = cipher;
-            mix_byte = cipher;
-
-            if (status_b == STATUS_ON) {
-                S = keystream_update(S, key_mx[keypos], counter++);
-            }
-            keypos = (keypos + 1) % KEY_SIZE;
-
-            if (outpos == sizeof outbuf) {
-                if (write_all(out_file, outbuf, outpos) < 0) {
-                    explicit_bzero(key_mx, KEY_SIZE);
-                    free(key_mx);
-                    free(out_path);
-                    fd_close(in_file);
-                    fd_close(out_file);
-                    return ERR_NO_WRITE;
-                }
-                outpos = 0;
-            }
-        }
-    }
-
-    // flush tail
-    if (outpos > 0) {
-        if (write_all(out_file, outbuf, outpos) < 0) {
-            explicit_bzero(key_mx, KEY_SIZE);
-            free(key_mx);
-            free(out_path);
-            fd_close(in_file);
-            fd_close(out_file);
-            return ERR_NO_WRITE;
-        }
-    }    
+    int stream_rc = run_plan(&st, DIR_ENCRYPT, in_file, out_file, 0, hdr.file_size, hdr.file_size, &job);
 
+    ta152_state_wipe(&st);
     free(out_path);
     explicit_bzero(key_mx, KEY_SIZE); 
     free(key_mx);
     fd_close(in_file);
     fd_close(out_file);
+
+    if (stream_rc < 0)
+        return stream_rc;
     return SUCCESS_ENCRYPT;
 }
 
 int ta152_decrypt(const char *in_path, const char *key_file) {
+    return ta152_decrypt_plan(in_path, key_file, NULL);
+}
+
+int ta152_decrypt_plan(const char *in_path, const char *key_file, const struct EnginePlan *plan) {
     size_t in_path_len = strlen(in_path);
     char extension[7];
     char *out_path = NULL;
@@ -453,13 +834,6 @@ int ta152_decrypt(const char *in_path, const char *key_file) {
         free(out_path);
         return ERR_KEY_NOT_LOADED;
     }
-    int keypos = 0;
-    
-    uint8_t base_mx[MATRIX_LEN];
-    uint8_t inverse_mx[MATRIX_LEN];
-
-    init_matrix(base_mx);
-    init_matrix(inverse_mx);
 
     int in_file = fd_open_read(in_path);
     if (in_file < 0) {
@@ -490,8 +864,6 @@ int ta152_decrypt(const char *in_path, const char *key_file) {
         return header_checker;
     }
 
-    uint32_t remaining_for_read = hdr.file_size;
-
     long long in_file_size = filesize_fd(in_file);
     if (in_file_size < 0) {
         free(out_path);
@@ -510,12 +882,22 @@ int ta152_decrypt(const char *in_path, const char *key_file) {
         return ERR_HEADER_INVALID;
     }
 
+    struct EnginePlan job;
+    int plan_rc = ta152_plan_job(&job, hdr.file_size, plan);
+    if (plan_rc < 0) {
+        free(out_path);
+        explicit_bzero(key_mx, KEY_SIZE); 
+        free(key_mx);
+        fd_close(in_file);
+        return plan_rc;
+    }
 
     int out_file = fd_open_write(out_path);
     if (out_file < 0) {
         free(out_path);
         explicit_bzero(key_mx, KEY_SIZE); 
         free(key_mx);
+        fd_close(in_file);
         return ERR_OPEN_FAILED;
     }
 
@@ -542,90 +924,19 @@ int ta152_decrypt(const char *in_path, const char *key_file) {
 
     fd_close(key_d);
 
-    uint8_t S = 0;
-    uint32_t counter = 0;
-
-    if (hdr.status == STATUS_ON) {
-        S = key_mx[0] ^ hdr.iv[0] ^ hdr.iv[1];
-        counter = (uint32_t) 0;
-    }
-
-    uint8_t inbuf[4096];
-    uint8_t outbuf[4096];
-    size_t outpos = 0;
-
-    uint8_t mix_byte = key_mx[0];   
-    if (hdr.status == STATUS_ON)
-        mix_byte = key_mx[0] ^ hdr.iv[15];
-
-    while (remaining_for_read > 0) {
-        ssize_t to_read = min_ssize(remaining_for_read, sizeof(inbuf));
-        ssize_t bytes_read = read(in_file, inbuf, to_read) ;
-        //ssize_t bytes_read = read(in_file, inbuf, sizeof inbuf);
-
-        if (bytes_read == 0) {
-            break; //EOF
-        }
-
-        remaining_for_read -= bytes_read;
-
-        if (bytes_read < 0) {
-            explicit_bzero(key_mx, KEY_SIZE);
-            free(key_mx);
-            free(out_path);
-            fd_close(in_file);
-            fd_close(out_file);
-            return ERR_NO_READ;
-        }
-
-        for (ssize_t i = 0; i < bytes_read; i++) {
-            uint8_t plain_buffer = inbuf[i];
-            if (hdr.status == STATUS_ON)
-                plain_buffer = plain_buffer ^ S;
+    struct CipherState st;
+    ta152_state_init(&st, key_mx, hdr.status, hdr.iv, job.engine);
 
-            uint8_t plain =
-                ta152_decrypt_chunk(plain_buffer, key_mx[keypos], base_mx, inverse_mx);
-            
-            plain = plain ^ mix_byte;
+    int stream_rc = run_plan(&st, DIR_DECRYPT, in_file, out_file, TA152_HEADER_SIZE, hdr.file_size, hdr.file_size, &job);
 
-            outbuf[outpos++] = plain;
-            mix_byte = inbuf[i];
-
-            if (hdr.status == STATUS_ON) {
-                S = keystream_update(S, key_mx[keypos], counter++);
-            }
-            keypos = (keypos + 1) % KEY_SIZE;
-
-            if (outpos == sizeof outbuf) {
-                if (write_all(out_file, outbuf, outpos) < 0) {
-                    explicit_bzero(key_mx, KEY_SIZE);
-                    free(key_mx);
-                    free(out_path);
-                    fd_close(in_file);
-                    fd_close(out_file);
-                    return ERR_NO_WRITE;
-                }
-                outpos = 0;
-            }
-        }
-    }
-
-    // flush tail
-    if (outpos > 0) {
-        if (write_all(out_file, outbuf, outpos) < 0) {
-            explicit_bzero(key_mx, KEY_SIZE);
-            free(key_mx);
-            free(out_path);
-            fd_close(in_file);
-            fd_close(out_file);
-            return ERR_NO_WRITE;
-        }
-    }  
-    
+    ta152_state_wipe(&st);
     free(out_path);
     explicit_bzero(key_mx, KEY_SIZE); 
     free(key_mx);
     fd_close(in_file);
     fd_close(out_file);
+
+    if (stream_rc < 0)
+        return stream_rc;
     return SUCCESS_DECRYPT;
-}
\ No newline at end of file
+}
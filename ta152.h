@@ -5,8 +5,15 @@
 #include <stdlib.h>
 #include <stddef.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct stat;
+
 #define SUCCESS_ENCRYPT 101
 #define SUCCESS_DECRYPT 102
+#define SUCCESS_UNCHANGED 103
 
 #define ERR_OPEN_FAILED -101
 #define ERR_NO_READ -102
@@ -22,6 +29,16 @@
 #define ERR_CANNOT_INIT_HEADER -116
 #define ERR_HEADER_INVALID -117
 #define ERR_UNSUPPORTED_VERSION -118
+#define ERR_UNKNOWN_ENGINE -119
+#define ERR_NO_MEMORY -120
+#define ERR_CALIBRATION_FAILED -121
+#define ERR_MEMBER_NOT_FOUND -122
+#define ERR_QUEUE_FULL -123
+#define ERR_CANCELLED -124
+#define ERR_JOB_NOT_FOUND -125
+#define ERR_BUFFER_TOO_SMALL -126
+#define ERR_INVALID_JOB -127
+#define ERR_NOT_REGULAR_FILE -128
 
 #define MATRIX_LEN 256
 #define KEY_SIZE 16
@@ -33,6 +50,130 @@
 #define STATUS_ON 1
 #define STATUS_OFF 0
 
+// engine kernels
+#define ENGINE_AUTO 0
+#define ENGINE_SCALAR 1
+#define ENGINE_TABLE 2
+#define ENGINE_PIPELINED 3
+#define ENGINE_COUNT 4
+
+#define PIPELINE_MAX_HELPERS 4
+
+// I/O backends
+#define IO_AUTO 0
+#define IO_READ 1
+#define IO_MMAP 2
+
+// tree mode
+#define TA152_MANIFEST_NAME ".t152m"
+#define TREE_HASH 1
+
+#define DIR_ENCRYPT 0
+#define DIR_DECRYPT 1
+
+// async jobs
+#define JOB_ENCRYPT 1
+#define JOB_DECRYPT 2
+#define JOB_RANGE 3
+
+#define JOB_SRC_PATH 1
+#define JOB_SRC_FD 2
+#define JOB_SRC_BUFFER 3
+
+// ta152_cancel results
+#define CANCEL_DONE 0
+#define CANCEL_REQUESTED 1
+
+// cipher state for one stream, see r1_spec.md section 2.c
+// the table engine keeps the permutation as prefix tables over one key cycle
+// (prefix_mx[j] = state after j + 1 rounds) and the running power of the full
+// cycle; each byte costs two lookups, and the power advances by one 256-entry
+// composition every KEY_SIZE bytes, about 18 lookups per byte amortized instead
+// of a full ta152_round (a 256-entry pass of swaps) per byte
+struct CipherState {
+    int engine;
+    int status;
+    int keypos;
+    uint8_t key[KEY_SIZE];
+    uint8_t S;
+    uint32_t counter;
+    uint8_t mix_byte;
+    uint8_t base_mx[MATRIX_LEN];
+    uint8_t inverse_mx[MATRIX_LEN];
+    uint8_t prefix_mx[KEY_SIZE][MATRIX_LEN];
+    uint8_t prefix_inv[KEY_SIZE][MATRIX_LEN];
+    uint8_t cycle_mx[MATRIX_LEN];
+    uint8_t cycle_inv[MATRIX_LEN];
+    struct Pipeline *pipeline;
+};
+
+// polled between buffers of a stream, a nonzero return stops it with ERR_CANCELLED
+typedef int (*ta152_cancel_fn)(void *ctx);
+
+// per-job engine decision, fields set to 0 / IO_AUTO / ENGINE_AUTO are picked by the tuner;
+// cancel is optional and carried over from the overrides as is
+struct EnginePlan {
+    int engine;
+    int io;
+    size_t buf_size;
+    int threads;
+    ta152_cancel_fn cancel;
+    void *cancel_ctx;
+};
+
+// outcome of one tree or archive run
+struct TreeStats {
+    long files;
+    long encrypted;
+    long unchanged;
+    long failed;
+    long long bytes;
+};
+
+// per-host calibration result, cached on disk by ta152_calibrate
+struct Calibration {
+    int version;
+    int nproc;
+    double setup_ns[ENGINE_COUNT];
+    double byte_ns[ENGINE_COUNT];
+};
+
+struct AsyncContext;
+
+// one request for ta152_submit, owned by the caller until it is reaped or its callback runs
+// encrypt/decrypt jobs produce the normal headered format; range jobs run the raw stream
+// (key, iv, status, dir) over length bytes at fixed offsets, or over in_len bytes of in_buf
+struct AsyncJob {
+    int op;
+    int src;
+    int status;
+    int dir;
+    const char *in_path;
+    const char *key_file;
+    int in_fd;
+    int out_fd;
+    uint64_t in_offset;
+    uint64_t out_offset;
+    uint64_t length;
+    const uint8_t *in_buf;
+    size_t in_len;
+    uint8_t *out_buf;
+    size_t out_cap;
+    uint8_t key[KEY_SIZE];
+    uint8_t iv[IV_SIZE];
+    struct EnginePlan plan;
+    void (*callback)(struct AsyncJob *job, void *arg);
+    void *callback_arg;
+    void *user_data;
+    // results, valid once the job completed
+    int rc;
+    size_t out_len;
+    // private to the context
+    struct AsyncJob *next;
+    int state;
+    int cancel;
+};
+
 //uint8_t ta152_round(uint8_t key, uint8_t *base_mx, uint8_t *inverse_mx);
 
 uint8_t ta152_encrypt_chunk(uint8_t input_chunk, uint8_t key_byte, uint8_t *base_mx, uint8_t *inverse_mx);
@@ -43,4 +184,78 @@ int ta152_encrypt(const char *in_path, const char *key_file, int status_b);
 
 int ta152_decrypt(const char *in_path, const char *key_file);
 
+int ta152_encrypt_plan(const char *in_path, const char *key_file, int status_b, const struct EnginePlan *plan);
+
+int ta152_decrypt_plan(const char *in_path, const char *key_file, const struct EnginePlan *plan);
+
+int ta152_encrypt_tree(const char *dir, const char *key_file, int status_b, int flags, const struct EnginePlan *plan, struct TreeStats *stats);
+
+int ta152_archive_create(const char *dir, const char *key_file, int status_b, const struct EnginePlan *plan, struct TreeStats *stats);
+
+int ta152_archive_extract(const char *archive, const char *key_file, const char *member, const struct EnginePlan *plan, struct TreeStats *stats);
+
+int ta152_encrypt_fd(int in_fd, int out_fd, const uint8_t key[KEY_SIZE], int status_b, const struct EnginePlan *plan);
+
+int ta152_decrypt_fd(int in_fd, int out_fd, const uint8_t key[KEY_SIZE], const struct EnginePlan *plan);
+
+int ta152_load_key(const char *key_file, uint8_t key[KEY_SIZE]);
+
+void ta152_header_encode(uint8_t out[TA152_HEADER_SIZE], int status, const uint8_t iv[IV_SIZE], uint32_t file_size);
+
+int ta152_header_decode(const uint8_t in[TA152_HEADER_SIZE], int *status, uint8_t iv[IV_SIZE], uint32_t *file_size);
+
+void ta152_state_init(struct CipherState *st, const uint8_t key[KEY_SIZE], int status, const uint8_t iv[IV_SIZE], int engine);
+
+void ta152_state_encrypt(struct CipherState *st, const uint8_t *in, uint8_t *out, size_t len);
+
+void ta152_state_decrypt(struct CipherState *st, const uint8_t *in, uint8_t *out, size_t len);
+
+void ta152_state_wipe(struct CipherState *st);
+
+int ta152_pipeline_start(struct CipherState *st, int dir, int helpers);
+
+void ta152_pipeline_process(struct CipherState *st, const uint8_t *in, uint8_t *out, size_t len);
+
+void ta152_pipeline_stop(struct CipherState *st);
+
+int ta152_crypt_range(struct CipherState *st, int dir, int in_fd, uint64_t in_off, int out_fd, uint64_t out_off, uint64_t len, size_t buf_size);
+
+const char *ta152_engine_name(int engine);
+
+int ta152_engine_parse(const char *name);
+
+typedef int (*ta152_visit_fn)(void *ctx, const char *path, const char *rel, const struct stat *st);
+
+typedef void (*ta152_task_fn)(void *ctx, size_t i);
+
+int ta152_walk_tree(const char *root, ta152_visit_fn visit, void *ctx);
+
+void ta152_parallel_for(int threads, size_t count, ta152_task_fn task, void *ctx);
+
+int ta152_make_parents(const char *path);
+
+int ta152_calibration_path(char *out, size_t len);
+
+int ta152_calibrate(struct Calibration *cal, int force);
+
+int ta152_plan_job(struct EnginePlan *plan, long long job_size, const struct EnginePlan *overrides);
+
+int ta152_plan_pool(struct EnginePlan *plan, long long total_bytes, size_t files, const struct EnginePlan *overrides);
+
+int ta152_async_create(struct AsyncContext **out, int threads, int depth);
+
+int ta152_async_fd(const struct AsyncContext *ctx);
+
+int ta152_submit(struct AsyncContext *ctx, struct AsyncJob *job);
+
+int ta152_cancel(struct AsyncContext *ctx, struct AsyncJob *job);
+
+int ta152_reap(struct AsyncContext *ctx, struct AsyncJob **jobs, int max);
+
+void ta152_async_destroy(struct AsyncContext *ctx);
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif
\ No newline at end of file
@@ -0,0 +1,379 @@
+#ifndef TA152_HPP
+#define TA152_HPP
+
+// header-only C++20 front end, byte-compatible with the C implementation in ta152.c
+// the cipher state lives inline in each object and update() never allocates
+
+#include <array>
+#include <cassert>
+#include <concepts>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <utility>
+#include "ta152.h"
+
+namespace ta152 {
+
+enum class IvMode { off = STATUS_OFF, on = STATUS_ON };
+enum class Direction { encrypt, decrypt };
+
+using Key = std::array<std::uint8_t, KEY_SIZE>;
+using Iv = std::array<std::uint8_t, IV_SIZE>;
+using HeaderBytes = std::array<std::uint8_t, TA152_HEADER_SIZE>;
+
+namespace detail {
+
+using Matrix = std::array<std::uint8_t, MATRIX_LEN>;
+
+inline void secure_zero(void *p, std::size_t len) noexcept {
+    volatile std::uint8_t *v = static_cast<volatile std::uint8_t *>(p);
+    while (len--)
+        *v++ = 0;
+}
+
+inline void init_matrix(Matrix &mx) noexcept {
+    for (int i = 0; i < MATRIX_LEN; i++)
+        mx[i] = static_cast<std::uint8_t>(i);
+}
+
+inline void swap_mx(Matrix &base, Matrix &inverse, int a, int b) noexcept {
+    std::uint8_t x = base[a];
+    std::uint8_t y = base[b];
+    base[a] = y;
+    base[b] = x;
+    inverse[x] = static_cast<std::uint8_t>(b);
+    inverse[y] = static_cast<std::uint8_t>(a);
+}
+
+// r1_spec.md section 2.d
+inline void round(std::uint8_t key, Matrix &base, Matrix &inverse) noexcept {
+    int chunk_size = (key == 0 || key == 1) ? 2 : key;
+
+    int offset = 0;
+    for (; offset + chunk_size <= MATRIX_LEN; offset += chunk_size) {
+        for (int i = 0; i < chunk_size / 2; i++)
+            swap_mx(base, inverse, offset + i, offset + chunk_size - 1 - i);
+    }
+
+    int leftover = MATRIX_LEN - offset;
+    for (int i = 0; i < leftover / 2; i++)
+        swap_mx(base, inverse, offset + i, offset + leftover - 1 - i);
+}
+
+inline void le_write_u32(std::uint8_t *p, std::uint32_t v) noexcept {
+    for (int i = 0; i < 4; i++)
+        p[i] = static_cast<std::uint8_t>(v >> (8 * i));
+}
+
+inline std::uint32_t le_read_u32(const std::uint8_t *p) noexcept {
+    std::uint32_t v = 0;
+    for (int i = 0; i < 4; i++)
+        v |= static_cast<std::uint32_t>(p[i]) << (8 * i);
+    return v;
+}
+
+template <class A>
+decltype(auto) get_awaiter(A &&a) {
+    if constexpr (requires { std::forward<A>(a).operator co_await(); })
+        return std::forward<A>(a).operator co_await();
+    else if constexpr (requires { operator co_await(std::forward<A>(a)); })
+        return operator co_await(std::forward<A>(a));
+    else
+        return std::forward<A>(a);
+}
+
+} // namespace detail
+
+// the table kernel of ta152.c with direction and IV mode fixed at compile time;
+// encryptors keep only the forward tables and decryptors only the inverse ones
+template <Direction D, IvMode M>
+class Cipher {
+public:
+    explicit Cipher(std::span<const std::uint8_t, KEY_SIZE> key) noexcept
+        requires(M == IvMode::off)
+    {
+        init(key, nullptr);
+    }
+
+    Cipher(std::span<const std::uint8_t, KEY_SIZE> key, std::span<const std::uint8_t, IV_SIZE> iv) noexcept
+        requires(M == IvMode::on)
+    {
+        init(key, iv.data());
+    }
+
+    Cipher(const Cipher &) = delete;
+    Cipher &operator=(const Cipher &) = delete;
+
+    // the moved-from object is wiped and must not be updated again
+    Cipher(Cipher &&other) noexcept {
+        take(other);
+    }
+
+    Cipher &operator=(Cipher &&other) noexcept {
+        if (this != &other) {
+            wipe();
+            take(other);
+        }
+        return *this;
+    }
+
+    ~Cipher() {
+        wipe();
+    }
+
+    // in and out must have the same size and may be the same buffer; a mismatch trips the
+    // assert in debug builds, otherwise only the shorter length is processed and returned
+    std::size_t update(std::span<const std::uint8_t> in, std::span<std::uint8_t> out) noexcept {
+        assert(in.size() == out.size());
+        const std::uint8_t *src = in.data();
+        std::uint8_t *dst = out.data();
+        std::size_t len = in.size() < out.size() ? in.size() : out.size();
+        const std::size_t processed = len;
+
+        // byte stores through dst may alias the members, so the feedback chain runs in locals
+        // and is written back once, as in the C table kernel
+        Chain c{ mix_byte_, s_, counter_ };
+        int keypos = keypos_;
+
+        // finish a partial key cycle, then run whole cycles with a fixed table per position
+        while (len > 0 && keypos != 0) {
+            *dst++ = step(c, *src++, keypos);
+            len--;
+            if (++keypos == KEY_SIZE) {
+                keypos = 0;
+                advance();
+            }
+        }
+
+        for (; len >= KEY_SIZE; len -= KEY_SIZE, src += KEY_SIZE, dst += KEY_SIZE) {
+            for (int j = 0; j < KEY_SIZE; j++)
+                dst[j] = step(c, src[j], j);
+            advance();
+        }
+
+        for (std::size_t i = 0; i < len; i++)
+            dst[i] = step(c, src[i], keypos++);
+
+        mix_byte_ = c.mix;
+        s_ = c.s;
+        counter_ = c.counter;
+        keypos_ = keypos;
+        return processed;
+    }
+
+    std::size_t update(std::span<std::uint8_t> inout) noexcept {
+        return update(inout, inout);
+    }
+
+private:
+    struct Chain {
+        std::uint8_t mix;
+        std::uint8_t s;
+        std::uint8_t counter;
+    };
+
+    void init(std::span<const std::uint8_t, KEY_SIZE> key, const std::uint8_t *iv) noexcept {
+        for (int i = 0; i < KEY_SIZE; i++)
+            key_[i] = key[i];
+
+        detail::Matrix base;
+        detail::Matrix inverse;
+        detail::init_matrix(base);
+        detail::init_matrix(inverse);
+        for (int j = 0; j < KEY_SIZE; j++) {
+            detail::round(key_[j], base, inverse);
+            prefix_[j] = D == Direction::encrypt ? base : inverse;
+        }
+        detail::secure_zero(base.data(), MATRIX_LEN);
+        detail::secure_zero(inverse.data(), MATRIX_LEN);
+        detail::init_matrix(cycle_);
+
+        mix_byte_ = key_[0];
+        if constexpr (M == IvMode::on) {
+            s_ = key_[0] ^ iv[0] ^ iv[1];
+            mix_byte_ = key_[0] ^ iv[15];
+        }
+    }
+
+    std::uint8_t step(Chain &c, std::uint8_t in, int j) const noexcept {
+        if constexpr (D == Direction::encrypt) {
+            std::uint8_t cipher = cycle_[prefix_[j][in ^ c.mix]];
+            if constexpr (M == IvMode::on) {
+                cipher ^= c.s;
+                keystream(c, j);
+            }
+            c.mix = cipher;
+            return cipher;
+        }
+        else {
+            std::uint8_t plain_buffer = in;
+            if constexpr (M == IvMode::on) {
+                plain_buffer ^= c.s;
+                keystream(c, j);
+            }
+            std::uint8_t plain = prefix_[j][cycle_[plain_buffer]] ^ c.mix;
+            c.mix = in;
+            return plain;
+        }
+    }
+
+    void keystream(Chain &c, int j) const noexcept {
+        c.s = static_cast<std::uint8_t>(c.s * 131 + key_[j] + c.counter++);
+    }
+
+    // Q^m -> Q^(m+1) for encryption, Q^-m -> Q^-(m+1) for decryption
+    void advance() noexcept {
+        const detail::Matrix &q = prefix_[KEY_SIZE - 1];
+        if constexpr (D == Direction::encrypt) {
+            detail::Matrix next;
+            for (int i = 0; i < MATRIX_LEN; i++)
+                next[i] = cycle_[q[i]];
+            cycle_ = next;
+        }
+        else {
+            for (int i = 0; i < MATRIX_LEN; i++)
+                cycle_[i] = q[cycle_[i]];
+        }
+    }
+
+    void take(Cipher &other) noexcept {
+        prefix_ = other.prefix_;
+        cycle_ = other.cycle_;
+        key_ = other.key_;
+        keypos_ = other.keypos_;
+        mix_byte_ = other.mix_byte_;
+        s_ = other.s_;
+        counter_ = other.counter_;
+        other.wipe();
+    }
+
+    void wipe() noexcept {
+        detail::secure_zero(this, sizeof *this);
+    }
+
+    std::array<detail::Matrix, KEY_SIZE> prefix_;
+    detail::Matrix cycle_;
+    Key key_;
+    int keypos_ = 0;
+    std::uint8_t mix_byte_ = 0;
+    std::uint8_t s_ = 0;
+    // only the low byte of the C counter takes part in the keystream
+    std::uint8_t counter_ = 0;
+};
+
+template <IvMode M>
+using Encryptor = Cipher<Direction::encrypt, M>;
+
+template <IvMode M>
+using Decryptor = Cipher<Direction::decrypt, M>;
+
+struct Header {
+    IvMode mode;
+    Iv iv;
+    std::uint32_t file_size;
+};
+
+// the 32-byte header ta152_encrypt writes in front of the payload
+inline HeaderBytes make_header(const Header &hdr) noexcept {
+    HeaderBytes out{};
+    out[0] = 'T';
+    out[1] = '1';
+    out[2] = '5';
+    out[3] = '2';
+    out[4] = VERSION;
+    out[5] = static_cast<std::uint8_t>(hdr.mode);
+    if (hdr.mode == IvMode::on) {
+        for (int i = 0; i < IV_SIZE; i++)
+            out[6 + i] = hdr.iv[i];
+    }
+    detail::le_write_u32(out.data() + 28, hdr.file_size);
+    return out;
+}
+
+inline std::optional<Header> parse_header(std::span<const std::uint8_t, TA152_HEADER_SIZE> in) noexcept {
+    if (!(in[0] == 'T' && in[1] == '1' && in[2] == '5' && in[3] == '2'))
+        return std::nullopt;
+    if (in[4] > VERSION || in[4] < 1)
+        return std::nullopt;
+    if (!(in[5] == STATUS_ON || in[5] == STATUS_OFF))
+        return std::nullopt;
+
+    Header hdr{};
+    hdr.mode = static_cast<IvMode>(in[5]);
+    for (int i = 0; i < IV_SIZE; i++)
+        hdr.iv[i] = in[6 + i];
+    hdr.file_size = detail::le_read_u32(in.data() + 28);
+    return hdr;
+}
+
+// forwards an awaiter and passes its result through fn on resumption
+template <class Awaiter, class Fn>
+class TransformAwaiter {
+public:
+    TransformAwaiter(Awaiter inner, Fn fn) : inner_(std::move(inner)), fn_(std::move(fn)) {}
+
+    bool await_ready() {
+        return inner_.await_ready();
+    }
+
+    template <class Promise>
+    decltype(auto) await_suspend(std::coroutine_handle<Promise> h) {
+        return inner_.await_suspend(h);
+    }
+
+    decltype(auto) await_resume() {
+        return fn_(inner_.await_resume());
+    }
+
+private:
+    Awaiter inner_;
+    Fn fn_;
+};
+
+template <class S>
+concept AsyncReadStream = requires(S &s, std::span<std::uint8_t> buf) { s.read_some(buf); };
+
+template <class S>
+concept AsyncWriteStream = requires(S &s, std::span<const std::uint8_t> buf) { s.write(buf); };
+
+// wraps any awaitable byte stream of the caller's event loop: read_some() yields bytes that
+// went through the cipher, write() runs the buffer through it in place before handing it on;
+// nothing is allocated and no awaiter type is imposed
+template <class C, class Stream>
+class AsyncStream {
+public:
+    AsyncStream(C &&cipher, Stream &stream) noexcept : cipher_(std::move(cipher)), stream_(stream) {}
+
+    auto read_some(std::span<std::uint8_t> buf)
+        requires AsyncReadStream<Stream>
+    {
+        auto fn = [this, buf](std::size_t n) {
+            cipher_.update(buf.first(n));
+            return n;
+        };
+        using Inner = std::decay_t<decltype(detail::get_awaiter(stream_.read_some(buf)))>;
+        return TransformAwaiter<Inner, decltype(fn)>(detail::get_awaiter(stream_.read_some(buf)), fn);
+    }
+
+    decltype(auto) write(std::span<std::uint8_t> buf)
+        requires AsyncWriteStream<Stream>
+    {
+        cipher_.update(buf);
+        return stream_.write(std::span<const std::uint8_t>(buf));
+    }
+
+    C &cipher() noexcept {
+        return cipher_;
+    }
+
+private:
+    C cipher_;
+    Stream &stream_;
+};
+
+} // namespace ta152
+
+#endif
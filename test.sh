@@ -5,6 +5,10 @@ BIN=./ta152
 DIR=testing
 HEADER_SIZE=32
 
+# keep engine calibration out of the user's cache
+export XDG_CACHE_HOME="$(mktemp -d)"
+trap 'rm -rf "$XDG_CACHE_HOME"' EXIT
+
 
 KEEP_FILES=(
     "keyfile_0.bin"
@@ -66,6 +70,104 @@ $BIN encrypt "$DIR/text_a.txt" "$DIR/keyfile_0.bin" -iv
 $BIN decrypt "$DIR/text_a.txt.t152e" "$DIR/keyfile_1.bin" || true
 ! cmp "$DIR/text_a.txt" "$DIR/text.txt"
 
+echo "[+] Tune report"
+$BIN tune "$DIR/og_src_img.jpg"
+
+echo "[+] Engine equivalence (scalar vs table, small file)"
+cp "$DIR/text.txt" "$DIR/text_a.txt"
+$BIN encrypt "$DIR/text_a.txt" "$DIR/keyfile_0.bin" --engine scalar
+cp "$DIR/text_a.txt.t152e" "$DIR/out_ref.bin"
+$BIN encrypt "$DIR/text_a.txt" "$DIR/keyfile_0.bin" --engine table
+cmp "$DIR/out_ref.bin" "$DIR/text_a.txt.t152e"
+
+echo "[+] Engine equivalence (scalar vs table, read vs --io mmap, multi-buffer file)"
+for i in $(seq 1 11); do cat "$DIR/og_src_img.jpg"; done > "$DIR/big.bin"
+$BIN encrypt "$DIR/big.bin" "$DIR/keyfile_1.bin" --engine scalar
+cp "$DIR/big.bin.t152e" "$DIR/big_ref.bin"
+$BIN encrypt "$DIR/big.bin" "$DIR/keyfile_1.bin" --io mmap
+cmp "$DIR/big_ref.bin" "$DIR/big.bin.t152e"
+cp "$DIR/big.bin" "$DIR/big_src.bin"
+$BIN decrypt "$DIR/big.bin.t152e" "$DIR/keyfile_1.bin" --engine scalar --threads 1 --io mmap
+cmp "$DIR/big.bin" "$DIR/big_src.bin"
+$BIN encrypt "$DIR/big.bin" "$DIR/keyfile_1.bin" -iv --engine table
+$BIN decrypt "$DIR/big.bin.t152e" "$DIR/keyfile_1.bin" --engine scalar
+cmp "$DIR/big.bin" "$DIR/big_src.bin"
+
+echo "[+] Engine equivalence (pipelined helpers)"
+$BIN encrypt "$DIR/big.bin" "$DIR/keyfile_1.bin" --engine pipelined --threads 3
+cmp "$DIR/big_ref.bin" "$DIR/big.bin.t152e"
+$BIN encrypt "$DIR/big.bin" "$DIR/keyfile_1.bin" -iv --engine pipelined --threads 2
+$BIN decrypt "$DIR/big.bin.t152e" "$DIR/keyfile_1.bin" --engine pipelined --threads 4
+cmp "$DIR/big.bin" "$DIR/big_src.bin"
+
+echo "[+] Tree mode (incremental)"
+TREE="$DIR/tree"
+mkdir -p "$TREE/sub"
+cp "$DIR/text.txt" "$TREE/a.txt"
+cp "$DIR/og_src_img.jpg" "$TREE/sub/b.jpg"
+cp "$DIR/text.txt" "$TREE/ lead.txt"
+$BIN encrypt-tree "$TREE" "$DIR/keyfile_0.bin" | grep -q "3 encrypted"
+$BIN encrypt-tree "$TREE" "$DIR/keyfile_0.bin" | grep -q "0 encrypted"
+echo "changed" >> "$TREE/a.txt"
+$BIN encrypt-tree "$TREE" "$DIR/keyfile_0.bin" --hash | grep -q "1 encrypted"
+touch "$TREE/sub/b.jpg"
+$BIN encrypt-tree "$TREE" "$DIR/keyfile_0.bin" --hash | grep -q "0 encrypted"
+$BIN encrypt-tree "$TREE" "$DIR/keyfile_1.bin" | grep -q "3 encrypted"
+cp "$TREE/a.txt" "$DIR/tree_a.txt"
+$BIN decrypt "$TREE/a.txt.t152e" "$DIR/keyfile_1.bin"
+cmp "$TREE/a.txt" "$DIR/tree_a.txt"
+rm -rf "$TREE"
+
+echo "[+] Archive round-trip and single-member extraction"
+ARC="$DIR/arc"
+mkdir -p "$ARC/sub"
+cp "$DIR/text.txt" "$ARC/a.txt"
+cp "$DIR/og_src_img.jpg" "$ARC/sub/b.jpg"
+: > "$ARC/empty"
+$BIN archive "$ARC" "$DIR/keyfile_0.bin" --threads 3
+cp "$DIR/arc.t152a" "$DIR/arc_ref.bin"
+$BIN archive "$ARC" "$DIR/keyfile_0.bin" --threads 1
+cmp "$DIR/arc.t152a" "$DIR/arc_ref.bin"
+mkdir "$DIR/arc.t152a.tmp"
+! $BIN archive "$ARC" "$DIR/keyfile_1.bin"
+cmp "$DIR/arc.t152a" "$DIR/arc_ref.bin"
+rmdir "$DIR/arc.t152a.tmp"
+rm -rf "$ARC"
+$BIN extract "$DIR/arc.t152a" "$DIR/keyfile_0.bin" sub/b.jpg
+cmp "$ARC/sub/b.jpg" "$DIR/og_src_img.jpg"
+[ ! -e "$ARC/a.txt" ]
+$BIN extract "$DIR/arc.t152a" "$DIR/keyfile_0.bin"
+cmp "$ARC/a.txt" "$DIR/text.txt"
+[ -f "$ARC/empty" ] && [ ! -s "$ARC/empty" ]
+! $BIN extract "$DIR/arc.t152a" "$DIR/keyfile_1.bin"
+$BIN archive "$ARC" "$DIR/keyfile_1.bin" -iv
+rm -rf "$ARC"
+$BIN extract "$DIR/arc.t152a" "$DIR/keyfile_1.bin" a.txt
+cmp "$ARC/a.txt" "$DIR/text.txt"
+rm -rf "$ARC"
+
+echo "[+] Batch mode (async jobs past the queue depth)"
+BATCH="$DIR/batch"
+mkdir -p "$BATCH"
+for i in $(seq 1 20); do cp "$DIR/text.txt" "$BATCH/t$i.txt"; done
+$BIN batch encrypt "$DIR/keyfile_0.bin" "$BATCH"/t*.txt --threads 2 | grep -q "20 files, 0 failed"
+cmp "$BATCH/t7.txt.t152e" "$DIR/out_ref.bin"
+$BIN batch encrypt "$DIR/keyfile_1.bin" "$BATCH"/t*.txt -iv
+$BIN batch decrypt "$DIR/keyfile_1.bin" "$BATCH"/t*.txt.t152e --threads 3
+for i in $(seq 1 20); do cmp "$BATCH/t$i.txt" "$DIR/text.txt"; done
+! $BIN batch decrypt "$DIR/keyfile_1.bin" "$BATCH/t1.txt.t152e" "$BATCH/missing.t152e"
+rm -rf "$BATCH"
+
+if [ -x ./ta152_async_test ]; then
+    echo "[+] Async job API checks (make check)"
+    ./ta152_async_test
+fi
+
+if [ -x ./ta152_bench ]; then
+    echo "[+] C++ front end cross-check (make bench)"
+    ./ta152_bench 1
+fi
+
 echo "[+] All tests passed"
 
 echo "[+] Cleanup: removing all generated files"
@@ -0,0 +1,541 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/stat.h>
+#include "ta152.h"
+
+// manifest layout, one record per line:
+//   T152M <version>
+//   key <ino> <size> <mtime_s> <mtime_ns> <status>
+//   f <size> <mtime_s> <mtime_ns> <ino> <hash> <relpath>
+// the key line invalidates every entry when the keyfile or IV mode changes
+#define MANIFEST_VERSION 1
+
+struct FileMeta {
+    long long size;
+    long long mtime_s;
+    long mtime_ns;
+    unsigned long long ino;
+    uint64_t hash;
+};
+
+struct ManifestEntry {
+    char *path;
+    struct FileMeta meta;
+};
+
+struct Manifest {
+    struct ManifestEntry *entries;
+    size_t count;
+    size_t cap;
+};
+
+struct TreeJob {
+    char *path;
+    const char *rel;
+    struct FileMeta meta;
+    const struct ManifestEntry *old;
+    int rc;
+};
+
+struct TreeRun {
+    struct TreeJob *jobs;
+    size_t count;
+    size_t cap;
+    const char *key_file;
+    int status;
+    int flags;
+    const struct EnginePlan *plan;
+    int key_changed;
+};
+
+static void meta_from_stat(struct FileMeta *meta, const struct stat *st) {
+    meta->size = st->st_size;
+    meta->mtime_s = st->st_mtim.tv_sec;
+    meta->mtime_ns = st->st_mtim.tv_nsec;
+    meta->ino = st->st_ino;
+    meta->hash = 0;
+}
+
+static int meta_equal(const struct FileMeta *a, const struct FileMeta *b) {
+    return a->size == b->size && a->mtime_s == b->mtime_s && a->mtime_ns == b->mtime_ns && a->ino == b->ino;
+}
+
+// FNV-1a over the whole file, 0 is reserved for "not hashed"
+static int content_hash(const char *path, uint64_t *out) {
+    uint8_t buf[65536];
+    uint64_t h = 0xcbf29ce484222325ULL;
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return ERR_OPEN_FAILED;
+
+    while (1) {
+        ssize_t r = read(fd, buf, sizeof buf);
+        if (r == 0)
+            break;
+        if (r < 0) {
+            close(fd);
+            return ERR_NO_READ;
+        }
+        for (ssize_t i = 0; i < r; i++) {
+            h ^= buf[i];
+            h *= 0x100000001b3ULL;
+        }
+    }
+    close(fd);
+
+    *out = h ? h : 1;
+    return 0;
+}
+
+static int has_suffix(const char *name, const char *suffix) {
+    size_t n = strlen(name);
+    size_t s = strlen(suffix);
+    return n >= s && strcmp(name + n - s, suffix) == 0;
+}
+
+static int manifest_cmp(const void *a, const void *b) {
+    const struct ManifestEntry *x = a;
+    const struct ManifestEntry *y = b;
+    return strcmp(x->path, y->path);
+}
+
+static void manifest_free(struct Manifest *m) {
+    for (size_t i = 0; i < m->count; i++)
+        free(m->entries[i].path);
+    free(m->entries);
+    memset(m, 0, sizeof *m);
+}
+
+// a missing or unreadable manifest loads as empty, so every file is encrypted
+static int manifest_load(struct Manifest *m, const char *path, const struct FileMeta *key_meta, int status, int *key_changed) {
+    memset(m, 0, sizeof *m);
+    *key_changed = 1;
+
+    FILE *f = fopen(path, "r");
+    if (!f)
+        return 0;
+
+    char line[4096 + 128];
+    int version = 0;
+    if (!fgets(line, sizeof line, f) || sscanf(line, "T152M %d", &version) != 1 || version != MANIFEST_VERSION) {
+        fclose(f);
+        return 0;
+    }
+
+    struct FileMeta km = {0};
+    int kstatus = -1;
+    if (!fgets(line, sizeof line, f) ||
+        sscanf(line, "key %llu %lld %lld %ld %d", &km.ino, &km.size, &km.mtime_s, &km.mtime_ns, &kstatus) != 5) {
+        fclose(f);
+        return 0;
+    }
+    if (!meta_equal(&km, key_meta) || kstatus != status) {
+        fclose(f);
+        return 0;
+    }
+    *key_changed = 0;
+
+    while (fgets(line, sizeof line, f)) {
+        struct FileMeta meta = {0};
+        int consumed = 0;
+        if (sscanf(line, "f %lld %lld %ld %llu %" SCNx64 "%n",
+                   &meta.size, &meta.mtime_s, &meta.mtime_ns, &meta.ino, &meta.hash, &consumed) != 5 || line[consumed] != ' ')
+            continue;
+
+        // exactly one separator, the path itself may start with spaces
+        char *rel = line + consumed + 1;
+        rel[strcspn(rel, "\n")] = '\0';
+        if (rel[0] == '\0')
+            continue;
+
+        if (m->count == m->cap) {
+            size_t cap = m->cap ? m->cap * 2 : 64;
+            struct ManifestEntry *grown = realloc(m->entries, cap * sizeof *grown);
+            if (!grown) {
+                fclose(f);
+                manifest_free(m);
+                return ERR_NO_MEMORY;
+            }
+            m->entries = grown;
+            m->cap = cap;
+        }
+
+        m->entries[m->count].path = strdup(rel);
+        if (!m->entries[m->count].path) {
+            fclose(f);
+            manifest_free(m);
+            return ERR_NO_MEMORY;
+        }
+        m->entries[m->count].meta = meta;
+        m->count++;
+    }
+    fclose(f);
+
+    qsort(m->entries, m->count, sizeof *m->entries, manifest_cmp);
+    return 0;
+}
+
+static const struct ManifestEntry *manifest_find(const struct Manifest *m, const char *rel) {
+    struct ManifestEntry key = { (char *)rel, {0} };
+    if (m->count == 0)
+        return NULL;
+    return bsearch(&key, m->entries, m->count, sizeof *m->entries, manifest_cmp);
+}
+
+static int add_job(void *ctx, const char *path, const char *rel, const struct stat *st) {
+    struct TreeRun *run = ctx;
+
+    if (has_suffix(rel, ".t152e") || strcmp(rel, TA152_MANIFEST_NAME) == 0)
+        return 0;
+
+    if (run->count == run->cap) {
+        size_t cap = run->cap ? run->cap * 2 : 64;
+        struct TreeJob *grown = realloc(run->jobs, cap * sizeof *grown);
+        if (!grown)
+            return ERR_NO_MEMORY;
+        run->jobs = grown;
+        run->cap = cap;
+    }
+
+    struct TreeJob *job = &run->jobs[run->count];
+    memset(job, 0, sizeof *job);
+    job->path = strdup(path);
+    if (!job->path)
+        return ERR_NO_MEMORY;
+    job->rel = job->path + (rel - path);
+    meta_from_stat(&job->meta, st);
+    run->count++;
+    return 0;
+}
+
+static int walk_dir(const char *dir, size_t root_len, ta152_visit_fn visit, void *ctx) {
+    DIR *d = opendir(dir);
+    if (!d)
+        return ERR_OPEN_FAILED;
+
+    struct dirent *ent;
+    int rc = 0;
+    while (rc == 0 && (ent = readdir(d)) != NULL) {
+        if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0)
+            continue;
+        if (strchr(ent->d_name, '\n'))
+            continue;
+
+        size_t len = strlen(dir) + 1 + strlen(ent->d_name) + 1;
+        char *path = malloc(len);
+        if (!path) {
+            rc = ERR_NO_MEMORY;
+            break;
+        }
+        snprintf(path, len, "%s/%s", dir, ent->d_name);
+
+        struct stat st;
+        if (lstat(path, &st) != 0) {
+            free(path);
+            continue;
+        }
+
+        if (S_ISDIR(st.st_mode))
+            rc = walk_dir(path, root_len, visit, ctx);
+        else if (S_ISREG(st.st_mode))
+            rc = visit(ctx, path, path + root_len + 1, &st);
+        free(path);
+    }
+
+    closedir(d);
+    return rc;
+}
+
+// calls visit for every regular file below root, with its path relative to root
+// symlinks and names containing a newline are skipped, a negative return stops the walk
+int ta152_walk_tree(const char *root, ta152_visit_fn visit, void *ctx) {
+    size_t root_len = strlen(root);
+    while (root_len > 1 && root[root_len - 1] == '/')
+        root_len--;
+
+    char *dir = strndup(root, root_len);
+    if (!dir)
+        return ERR_NO_MEMORY;
+
+    int rc = walk_dir(dir, root_len, visit, ctx);
+    free(dir);
+    return rc;
+}
+
+struct ParallelRun {
+    size_t count;
+    ta152_task_fn task;
+    void *ctx;
+    atomic_size_t next;
+};
+
+static void *parallel_worker(void *arg) {
+    struct ParallelRun *run = arg;
+    while (1) {
+        size_t i = atomic_fetch_add(&run->next, 1);
+        if (i >= run->count)
+            break;
+        run->task(run->ctx, i);
+    }
+    return NULL;
+}
+
+// runs task(ctx, i) for i in [0, count) on up to threads threads, the caller included
+void ta152_parallel_for(int threads, size_t count, ta152_task_fn task, void *ctx) {
+    struct ParallelRun run;
+    run.count = count;
+    run.task = task;
+    run.ctx = ctx;
+    atomic_init(&run.next, 0);
+
+    if ((size_t)threads > count)
+        threads = count ? (int)count : 1;
+
+    pthread_t *tids = threads > 1 ? calloc(threads - 1, sizeof *tids) : NULL;
+    int started = 0;
+    if (tids) {
+        for (; started < threads - 1; started++) {
+            if (pthread_create(&tids[started], NULL, parallel_worker, &run) != 0)
+                break;
+        }
+    }
+    parallel_worker(&run);
+    for (int i = 0; i < started; i++)
+        pthread_join(tids[i], NULL);
+    free(tids);
+}
+
+// mkdir -p for the parent directories of path
+int ta152_make_parents(const char *path) {
+    char dir[4096];
+    size_t len = strlen(path);
+    if (len >= sizeof dir)
+        return ERR_NO_PATH_OUT;
+    memcpy(dir, path, len + 1);
+
+    for (char *p = dir + 1; *p; p++) {
+        if (*p != '/')
+            continue;
+        *p = '\0';
+        if (mkdir(dir, 0755) != 0 && errno != EEXIST)
+            return ERR_OPEN_FAILED;
+        *p = '/';
+    }
+    return 0;
+}
+
+static int output_current(const char *path, long long size) {
+    size_t len = strlen(path) + 7;
+    char *out_path = malloc(len);
+    if (!out_path)
+        return 0;
+    snprintf(out_path, len, "%s.t152e", path);
+
+    struct stat st;
+    int ok = stat(out_path, &st) == 0 && st.st_size == size + TA152_HEADER_SIZE;
+    free(out_path);
+    return ok;
+}
+
+static int job_unchanged(const struct TreeRun *run, struct TreeJob *job) {
+    const struct ManifestEntry *old = job->old;
+    if (!old || run->key_changed || !output_current(job->path, job->meta.size))
+        return 0;
+
+    if (!(run->flags & TREE_HASH))
+        return meta_equal(&old->meta, &job->meta);
+
+    if (old->meta.hash == 0)
+        return meta_equal(&old->meta, &job->meta);
+    return old->meta.size == job->meta.size && old->meta.hash == job->meta.hash;
+}
+
+static void run_job(struct TreeRun *run, struct TreeJob *job) {
+    // --hash reads a file only when its metadata moved, to tell a touch from an edit, or
+    // once to record a hash it does not have yet; otherwise the recorded hash carries over
+    const struct ManifestEntry *old = job->old;
+    int same_meta = old && meta_equal(&old->meta, &job->meta);
+    if (same_meta)
+        job->meta.hash = old->meta.hash;
+
+    if ((run->flags & TREE_HASH) && (!same_meta || job->meta.hash == 0)) {
+        job->rc = content_hash(job->path, &job->meta.hash);
+        if (job->rc < 0)
+            return;
+    }
+
+    if (job_unchanged(run, job)) {
+        job->rc = SUCCESS_UNCHANGED;
+        return;
+    }
+
+    job->rc = ta152_encrypt_plan(job->path, run->key_file, run->status, run->plan);
+}
+
+static void tree_task(void *ctx, size_t i) {
+    struct TreeRun *run = ctx;
+    run_job(run, &run->jobs[i]);
+}
+
+static int manifest_store(const struct TreeRun *run, const char *path, const struct FileMeta *key_meta) {
+    size_t len = strlen(path) + 5;
+    char *tmp = malloc(len);
+    if (!tmp)
+        return ERR_NO_MEMORY;
+    snprintf(tmp, len, "%s.tmp", path);
+
+    FILE *f = fopen(tmp, "w");
+    if (!f) {
+        free(tmp);
+        return ERR_OPEN_FAILED;
+    }
+
+    fprintf(f, "T152M %d\n", MANIFEST_VERSION);
+    fprintf(f, "key %llu %lld %lld %ld %d\n", key_meta->ino, key_meta->size, key_meta->mtime_s, key_meta->mtime_ns, run->status);
+
+    for (size_t i = 0; i < run->count; i++) {
+        const struct TreeJob *job = &run->jobs[i];
+        if (job->rc != SUCCESS_ENCRYPT && job->rc != SUCCESS_UNCHANGED)
+            continue;
+
+        // an unhashed run keeps the previous hash as long as the metadata still matches
+        uint64_t hash = job->meta.hash;
+        if (hash == 0 && job->old && meta_equal(&job->old->meta, &job->meta))
+            hash = job->old->meta.hash;
+
+        fprintf(f, "f %lld %lld %ld %llu %" PRIx64 " %s\n",
+                job->meta.size, job->meta.mtime_s, job->meta.mtime_ns, job->meta.ino, hash, job->rel);
+    }
+
+    if (fclose(f) != 0 || rename(tmp, path) != 0) {
+        unlink(tmp);
+        free(tmp);
+        return ERR_NO_WRITE;
+    }
+    free(tmp);
+    return 0;
+}
+
+// encrypts every new or modified regular file below dir into <file>.t152e, in parallel,
+// tracking what was encrypted in <dir>/.t152m so unchanged files are skipped next run
+int ta152_encrypt_tree(const char *dir, const char *key_file, int status_b, int flags, const struct EnginePlan *plan, struct TreeStats *stats) {
+    if (!(status_b == STATUS_ON || status_b == STATUS_OFF))
+        return ERR_UNDEFINED_STATUS;
+
+    struct stat key_st;
+    if (stat(key_file, &key_st) != 0)
+        return ERR_OPEN_FAILED;
+    struct FileMeta key_meta;
+    meta_from_stat(&key_meta, &key_st);
+
+    size_t root_len = strlen(dir);
+    while (root_len > 1 && dir[root_len - 1] == '/')
+        root_len--;
+
+    char *root = strndup(dir, root_len);
+    if (!root)
+        return ERR_NO_MEMORY;
+
+    size_t manifest_len = root_len + strlen(TA152_MANIFEST_NAME) + 2;
+    char *manifest_path = malloc(manifest_len);
+    if (!manifest_path) {
+        free(root);
+        return ERR_NO_MEMORY;
+    }
+    snprintf(manifest_path, manifest_len, "%s/%s", root, TA152_MANIFEST_NAME);
+
+    struct TreeRun run = {0};
+    run.key_file = key_file;
+    run.status = status_b;
+    run.flags = flags;
+
+    struct Manifest manifest;
+    int rc = manifest_load(&manifest, manifest_path, &key_meta, status_b, &run.key_changed);
+    if (rc == 0)
+        rc = ta152_walk_tree(root, add_job, &run);
+
+    if (rc < 0) {
+        for (size_t i = 0; i < run.count; i++)
+            free(run.jobs[i].path);
+        free(run.jobs);
+        manifest_free(&manifest);
+        free(manifest_path);
+        free(root);
+        return rc;
+    }
+
+    // size the pool on the bytes that will actually be read, not the whole tree
+    long long pending_bytes = 0;
+    size_t pending_files = 0;
+    for (size_t i = 0; i < run.count; i++) {
+        struct TreeJob *job = &run.jobs[i];
+        job->old = manifest_find(&manifest, job->rel);
+        if (run.key_changed || !job->old || !meta_equal(&job->old->meta, &job->meta)) {
+            pending_bytes += job->meta.size;
+            pending_files++;
+        }
+    }
+
+    struct EnginePlan job_plan;
+    rc = ta152_plan_pool(&job_plan, pending_bytes, pending_files, plan);
+
+    // the pool already runs one file per thread, only a lone pending file is planned
+    // on its own and may use several threads
+    struct EnginePlan file_plan = {0};
+    if (plan)
+        file_plan = *plan;
+    if (pending_files > 1)
+        file_plan.threads = 1;
+    run.plan = &file_plan;
+
+    if (rc == 0)
+        ta152_parallel_for(job_plan.threads, run.count, tree_task, &run);
+
+    struct TreeStats st = {0};
+    int first_error = 0;
+    for (size_t i = 0; i < run.count; i++) {
+        const struct TreeJob *job = &run.jobs[i];
+        st.files++;
+        if (job->rc == SUCCESS_UNCHANGED) {
+            st.unchanged++;
+        }
+        else if (job->rc == SUCCESS_ENCRYPT) {
+            st.encrypted++;
+            st.bytes += job->meta.size;
+        }
+        else {
+            st.failed++;
+            if (first_error == 0)
+                first_error = job->rc;
+        }
+    }
+
+    if (rc == 0)
+        rc = manifest_store(&run, manifest_path, &key_meta);
+
+    for (size_t i = 0; i < run.count; i++)
+        free(run.jobs[i].path);
+    free(run.jobs);
+    manifest_free(&manifest);
+    free(manifest_path);
+    free(root);
+
+    if (stats)
+        *stats = st;
+    if (rc < 0)
+        return rc;
+    if (first_error < 0)
+        return first_error;
+    return SUCCESS_ENCRYPT;
+}
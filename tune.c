@@ -0,0 +1,320 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "ta152.h"
+
+// bump whenever a kernel is added or changed, stale cache files are then recalibrated
+#define CALIBRATION_VERSION 2
+#define CALIBRATION_CHUNK 4096
+#define CALIBRATION_MIN_NS 5000000.0
+#define CALIBRATION_SETUP_RUNS 16
+
+// job size thresholds used by ta152_plan_job
+#define SMALL_JOB_SIZE (64 * 1024)
+#define LARGE_JOB_SIZE (16 * 1024 * 1024)
+#define PARALLEL_MIN_SIZE (4 * 1024 * 1024)
+// open, stat, create and state setup of one file in a pool, counted as this many bytes of work
+#define FILE_OVERHEAD_SIZE (64 * 1024)
+
+static const char *engine_names[ENGINE_COUNT] = { "auto", "scalar", "table", "pipelined" };
+
+// shared by every job in the process, guarded for the tree worker pool
+static pthread_mutex_t host_cal_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct Calibration host_cal;
+static int host_cal_loaded = 0;
+
+const char *ta152_engine_name(int engine) {
+    if (engine < 0 || engine >= ENGINE_COUNT)
+        return "unknown";
+    return engine_names[engine];
+}
+
+int ta152_engine_parse(const char *name) {
+    for (int i = 0; i < ENGINE_COUNT; i++) {
+        if (strcmp(name, engine_names[i]) == 0)
+            return i;
+    }
+    return ERR_UNKNOWN_ENGINE;
+}
+
+static double now_ns(void) {
+    struct timespec ts;
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0)
+        return -1.0;
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+// $XDG_CACHE_HOME/ta152/calibration-<host>, falling back to ~/.cache
+int ta152_calibration_path(char *out, size_t len) {
+    char host[256];
+    const char *base = getenv("XDG_CACHE_HOME");
+    const char *suffix = "";
+
+    if (!base || base[0] == '\0') {
+        base = getenv("HOME");
+        suffix = "/.cache";
+    }
+    if (!base || base[0] == '\0')
+        return ERR_NO_PATH_OUT;
+
+    if (gethostname(host, sizeof host) != 0)
+        strcpy(host, "localhost");
+    host[sizeof host - 1] = '\0';
+
+    int n = snprintf(out, len, "%s%s/ta152/calibration-%s", base, suffix, host);
+    if (n < 0 || (size_t)n >= len)
+        return ERR_NO_PATH_OUT;
+    return 0;
+}
+
+static int load_calibration(struct Calibration *cal, const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f)
+        return ERR_OPEN_FAILED;
+
+    memset(cal, 0, sizeof *cal);
+    char line[128];
+    int seen = 0;
+    while (fgets(line, sizeof line, f)) {
+        char name[32];
+        double setup_ns, byte_ns;
+        int value;
+
+        if (sscanf(line, "version=%d", &value) == 1) {
+            cal->version = value;
+        }
+        else if (sscanf(line, "nproc=%d", &value) == 1) {
+            cal->nproc = value;
+        }
+        else if (sscanf(line, "engine=%31s %lf %lf", name, &setup_ns, &byte_ns) == 3) {
+            int engine = ta152_engine_parse(name);
+            if (engine > ENGINE_AUTO) {
+                cal->setup_ns[engine] = setup_ns;
+                cal->byte_ns[engine] = byte_ns;
+                seen++;
+            }
+        }
+    }
+    fclose(f);
+
+    if (cal->version != CALIBRATION_VERSION || cal->nproc < 1 || seen != ENGINE_COUNT - 1)
+        return ERR_CALIBRATION_FAILED;
+    return 0;
+}
+
+static int store_calibration(const struct Calibration *cal, const char *path) {
+    char tmp[4096 + 8];
+    if (ta152_make_parents(path) < 0)
+        return ERR_OPEN_FAILED;
+
+    snprintf(tmp, sizeof tmp, "%s.tmp", path);
+    FILE *f = fopen(tmp, "w");
+    if (!f)
+        return ERR_OPEN_FAILED;
+
+    fprintf(f, "version=%d\n", cal->version);
+    fprintf(f, "nproc=%d\n", cal->nproc);
+    for (int i = ENGINE_AUTO + 1; i < ENGINE_COUNT; i++)
+        fprintf(f, "engine=%s %.1f %.4f\n", engine_names[i], cal->setup_ns[i], cal->byte_ns[i]);
+
+    if (fclose(f) != 0) {
+        unlink(tmp);
+        return ERR_NO_WRITE;
+    }
+    if (rename(tmp, path) != 0) {
+        unlink(tmp);
+        return ERR_NO_WRITE;
+    }
+    return 0;
+}
+
+// time state setup and in-memory encryption for every kernel
+static int run_calibration(struct Calibration *cal) {
+    static const uint8_t key[KEY_SIZE] = {
+        0x3a, 0x91, 0x07, 0xc4, 0x5e, 0x12, 0xfd, 0x68,
+        0x2b, 0xa0, 0x77, 0x01, 0xe9, 0x4c, 0xb3, 0x96
+    };
+    uint8_t iv[IV_SIZE] = {0};
+    uint8_t buf[CALIBRATION_CHUNK];
+
+    struct CipherState *st = malloc(sizeof *st);
+    if (!st)
+        return ERR_NO_MEMORY;
+
+    memset(cal, 0, sizeof *cal);
+    cal->version = CALIBRATION_VERSION;
+
+    long nproc = sysconf(_SC_NPROCESSORS_ONLN);
+    cal->nproc = nproc > 0 ? (int)nproc : 1;
+
+    for (int i = 0; i < CALIBRATION_CHUNK; i++)
+        buf[i] = (uint8_t)(i * 167 + 13);
+
+    // the pipelined engine is measured with the helpers a large job would get
+    int helpers = cal->nproc > 1 ? cal->nproc - 1 : 1;
+
+    for (int engine = ENGINE_AUTO + 1; engine < ENGINE_COUNT; engine++) {
+        double start = now_ns();
+        for (int r = 0; r < CALIBRATION_SETUP_RUNS; r++) {
+            ta152_state_init(st, key, STATUS_ON, iv, engine);
+            if (engine == ENGINE_PIPELINED && ta152_pipeline_start(st, DIR_ENCRYPT, helpers) == 0)
+                ta152_pipeline_stop(st);
+        }
+        double elapsed = now_ns() - start;
+        if (start < 0 || elapsed < 0) {
+            ta152_state_wipe(st);
+            free(st);
+            return ERR_CALIBRATION_FAILED;
+        }
+        cal->setup_ns[engine] = elapsed / CALIBRATION_SETUP_RUNS;
+
+        if (engine == ENGINE_PIPELINED) {
+            ta152_state_init(st, key, STATUS_ON, iv, engine);
+            ta152_pipeline_start(st, DIR_ENCRYPT, helpers);
+        }
+
+        long long bytes = 0;
+        start = now_ns();
+        do {
+            ta152_state_encrypt(st, buf, buf, sizeof buf);
+            bytes += sizeof buf;
+            elapsed = now_ns() - start;
+        } while (elapsed < CALIBRATION_MIN_NS);
+        cal->byte_ns[engine] = elapsed / (double)bytes;
+        ta152_pipeline_stop(st);
+    }
+
+    ta152_state_wipe(st);
+    free(st);
+    return 0;
+}
+
+// loads the cached per-host calibration, running and storing it on first use
+// force reruns the benchmark regardless of the cache
+int ta152_calibrate(struct Calibration *cal, int force) {
+    char path[4096];
+    int have_path = ta152_calibration_path(path, sizeof path) == 0;
+
+    pthread_mutex_lock(&host_cal_lock);
+
+    if (!force && host_cal_loaded) {
+        *cal = host_cal;
+        pthread_mutex_unlock(&host_cal_lock);
+        return 0;
+    }
+
+    if (!force && have_path && load_calibration(&host_cal, path) == 0) {
+        host_cal_loaded = 1;
+        *cal = host_cal;
+        pthread_mutex_unlock(&host_cal_lock);
+        return 0;
+    }
+
+    int rc = run_calibration(&host_cal);
+    if (rc < 0) {
+        host_cal_loaded = 0;
+        pthread_mutex_unlock(&host_cal_lock);
+        return rc;
+    }
+    host_cal_loaded = 1;
+
+    // a read-only cache directory only costs a recalibration next run
+    if (have_path)
+        store_calibration(&host_cal, path);
+
+    *cal = host_cal;
+    pthread_mutex_unlock(&host_cal_lock);
+    return 0;
+}
+
+// the pipelined engine needs a second thread for its helpers
+static int pick_engine(const struct Calibration *cal, long long job_size, int threads) {
+    int best = ENGINE_TABLE;
+    double best_ns = 0;
+
+    for (int engine = ENGINE_AUTO + 1; engine < ENGINE_COUNT; engine++) {
+        if (engine == ENGINE_PIPELINED && threads < 2)
+            continue;
+        double cost = cal->setup_ns[engine] + cal->byte_ns[engine] * (double)job_size;
+        if (engine == ENGINE_AUTO + 1 || cost < best_ns) {
+            best = engine;
+            best_ns = cost;
+        }
+    }
+    return best;
+}
+
+// fills plan for a job of job_size bytes, honouring any non-auto field in overrides
+int ta152_plan_job(struct EnginePlan *plan, long long job_size, const struct EnginePlan *overrides) {
+    struct EnginePlan o = {0};
+    if (overrides)
+        o = *overrides;
+
+    if (o.engine < ENGINE_AUTO || o.engine >= ENGINE_COUNT)
+        return ERR_UNKNOWN_ENGINE;
+    if (o.io < IO_AUTO || o.io > IO_MMAP)
+        return ERR_UNKNOWN_ENGINE;
+    if (job_size < 0)
+        job_size = 0;
+
+    struct Calibration cal;
+    int calibrated = 0;
+    if (o.engine == ENGINE_AUTO || o.threads <= 0)
+        calibrated = ta152_calibrate(&cal, 0) == 0;
+
+    // mmap is opt-in only: an input truncated while mapped kills the process with SIGBUS,
+    // where the read loop just reports a short read
+    if (o.io != IO_AUTO)
+        plan->io = o.io;
+    else
+        plan->io = IO_READ;
+
+    if (o.buf_size > 0)
+        plan->buf_size = o.buf_size;
+    else if (job_size < SMALL_JOB_SIZE)
+        plan->buf_size = 4096;
+    else if (job_size < LARGE_JOB_SIZE)
+        plan->buf_size = 64 * 1024;
+    else
+        plan->buf_size = 1024 * 1024;
+
+    if (o.threads > 0)
+        plan->threads = o.threads;
+    else if (job_size < PARALLEL_MIN_SIZE || !calibrated)
+        plan->threads = 1;
+    else
+        plan->threads = cal.nproc;
+
+    if (o.engine != ENGINE_AUTO)
+        plan->engine = o.engine;
+    else if (calibrated)
+        plan->engine = pick_engine(&cal, job_size, plan->threads);
+    else
+        plan->engine = ENGINE_TABLE;
+
+    plan->cancel = o.cancel;
+    plan->cancel_ctx = o.cancel_ctx;
+    return 0;
+}
+
+// plans a pool that runs one file per thread: each file adds FILE_OVERHEAD_SIZE to the bytes,
+// so many small files still go parallel, and the pool never outnumbers the files
+int ta152_plan_pool(struct EnginePlan *plan, long long total_bytes, size_t files, const struct EnginePlan *overrides) {
+    int rc = ta152_plan_job(plan, total_bytes, overrides);
+    if (rc < 0)
+        return rc;
+
+    struct Calibration cal;
+    long long work = total_bytes + (long long)files * FILE_OVERHEAD_SIZE;
+    if ((!overrides || overrides->threads <= 0) && work >= PARALLEL_MIN_SIZE && ta152_calibrate(&cal, 0) == 0)
+        plan->threads = cal.nproc;
+
+    if (files > 0 && (size_t)plan->threads > files)
+        plan->threads = (int)files;
+    return 0;
+}